@@ -0,0 +1,134 @@
+/*
+ * assignment_cache.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Memoizing nearest-centroid assignment. Pixels are processed in blocks: a first pass resolves each
+ * pixel from the previous pixel or the cache where possible and gathers the rest, which the SIMD
+ * kernel then searches together, and a second pass fills in the labels in order.
+ */
+
+#include "assignment_cache.h"
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint32_t kValid = 1u << 24;        // distinguishes keys from empty cache slots
+static constexpr uint16_t kFromPrevious = 0x100;    // first pass markers, distinct from any label
+static constexpr uint16_t kFromSearch = 0x101;
+
+// Key identifying a pixel's RGB color (in whatever order the pixel's bytes load in)
+static inline uint32_t colorKey(const uint8_t *pixel)
+{
+    uint32_t value;
+    memcpy(&value, pixel, 4);
+    return (value & 0x00ffffff) | kValid;
+}
+
+// Whether the 4 pixels starting at pixel all have the given key. The valid bit is compared too, so
+// that the empty key of a cache with no previous pixel never matches.
+static inline bool isRunOf4(const uint8_t *pixel, uint32_t key)
+{
+    uint32_t values[4];
+    memcpy(values, pixel, 16);
+    uint32_t differences = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        differences |= ((values[i] & 0x00ffffff) | kValid) ^ key;
+    }
+    return differences == 0;
+}
+
+AssignmentCache::AssignmentCache(const Centroid centroids[], size_t numCentroids, posterize_metric metric)
+    : m_centroids(centroids),
+      m_assignPixels(getAssignPixelsKernel(metric, numCentroids))
+{
+    std::fill(m_keys, m_keys + kCacheSize, 0);
+}
+
+bool AssignmentCache::assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels)
+{
+    bool didChange = false;
+    for (size_t blockStart = 0; blockStart < numPixels; blockStart += kBlockSize)
+    {
+        size_t blockPixels = std::min(kBlockSize, numPixels - blockStart);
+        const uint8_t *pixels = &rgba[blockStart * 4];
+        uint16_t blockLabels[kBlockSize];
+        uint8_t missPixels[kBlockSize * 4];
+        uint8_t missLabels[kBlockSize];
+        size_t numMisses = 0;
+
+        uint32_t previousKey = m_previousKey;
+        for (size_t i = 0; i < blockPixels; i++)
+        {
+            // Flat regions: consume whole groups of pixels that continue a run
+            if ((i & 3) == 0 && i + 4 <= blockPixels && isRunOf4(&pixels[i * 4], previousKey))
+            {
+                std::fill(&blockLabels[i], &blockLabels[i + 4], kFromPrevious);
+                m_stats.runHits += 4;
+                i += 3;
+                continue;
+            }
+
+            uint32_t key = colorKey(&pixels[i * 4]);
+            if (key == previousKey)
+            {
+                blockLabels[i] = kFromPrevious;
+                m_stats.runHits++;
+            }
+            else if (m_keys[slot(key)] == key)
+            {
+                blockLabels[i] = m_labels[slot(key)];
+                m_stats.cacheHits++;
+            }
+            else
+            {
+                blockLabels[i] = kFromSearch;
+                memcpy(&missPixels[numMisses * 4], &pixels[i * 4], 4);
+                numMisses++;
+            }
+            previousKey = key;
+        }
+        m_stats.misses += numMisses;
+
+        m_assignPixels(missLabels, missPixels, numMisses, m_centroids);
+
+        size_t miss = 0;
+        uint8_t previousLabel = m_previousLabel;
+        for (size_t i = 0; i < blockPixels; i++)
+        {
+            static const uint16_t runOf4[4] = { kFromPrevious, kFromPrevious, kFromPrevious, kFromPrevious };
+            if ((i & 3) == 0 && i + 4 <= blockPixels && memcmp(&blockLabels[i], runOf4, sizeof(runOf4)) == 0)
+            {
+                for (size_t j = i; j < i + 4; j++)
+                {
+                    didChange |= labels[blockStart + j] != previousLabel;
+                    labels[blockStart + j] = previousLabel;
+                }
+                i += 3;
+                continue;
+            }
+
+            uint8_t k;
+            if (blockLabels[i] == kFromPrevious)
+            {
+                k = previousLabel;
+            }
+            else if (blockLabels[i] == kFromSearch)
+            {
+                k = missLabels[miss++];
+                uint32_t key = colorKey(&pixels[i * 4]);
+                m_keys[slot(key)] = key;
+                m_labels[slot(key)] = k;
+            }
+            else
+            {
+                k = uint8_t(blockLabels[i]);
+            }
+            previousLabel = k;
+            didChange |= labels[blockStart + i] != k;
+            labels[blockStart + i] = k;
+        }
+        m_previousKey = previousKey;
+        m_previousLabel = previousLabel;
+    }
+    return didChange;
+}
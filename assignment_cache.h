@@ -0,0 +1,67 @@
+/*
+ * assignment_cache.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Memoizing nearest-centroid assignment for images with runs and repeated colors.
+ */
+
+#ifndef ASSIGNMENT_CACHE_H
+#define ASSIGNMENT_CACHE_H
+
+#include "nearest_centroid.h"
+#include <cstddef>
+#include <cstdint>
+
+// Number of pixels served by each source during cached assignment
+struct AssignmentCacheStats
+{
+    size_t runHits = 0;     // same color as the previous pixel
+    size_t cacheHits = 0;   // found in the direct-mapped cache
+    size_t misses = 0;      // searched with the assignment kernel
+
+    void add(const AssignmentCacheStats &other)
+    {
+        runHits += other.runHits;
+        cacheHits += other.cacheHits;
+        misses += other.misses;
+    }
+};
+
+// Assigns pixels like an AssignPixelsFn, but reuses the result for a pixel with the same color as
+// the previous one or as a recently searched one held in a small direct-mapped cache. Pixels that
+// miss are gathered and searched together with the SIMD kernel. Results are identical to the
+// kernel's for the metric. A cache is valid for one set of centroids and must be used by one thread
+// at a time.
+class AssignmentCache
+{
+public:
+    AssignmentCache(const Centroid centroids[], size_t numCentroids, posterize_metric metric);
+
+    // Consecutive calls continue the same pixel sequence, so runs can span calls
+    bool assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels);
+
+    const AssignmentCacheStats &stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    static constexpr size_t kCacheBits = 12;
+    static constexpr size_t kCacheSize = size_t(1) << kCacheBits;
+    static constexpr size_t kBlockSize = 256;
+
+    static size_t slot(uint32_t key)
+    {
+        return uint32_t(key * 0x9e3779b1u) >> (32 - kCacheBits);
+    }
+
+    const Centroid *m_centroids;
+    AssignPixelsFn m_assignPixels;
+    uint32_t m_keys[kCacheSize];    // color | kValid, or 0 if empty
+    uint8_t m_labels[kCacheSize];
+    uint32_t m_previousKey = 0;     // empty until a pixel has been assigned
+    uint8_t m_previousLabel = 0;
+    AssignmentCacheStats m_stats;
+};
+
+#endif // ASSIGNMENT_CACHE_H
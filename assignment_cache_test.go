@@ -0,0 +1,60 @@
+package main
+
+import (
+	"bytes"
+	"math/rand"
+	"testing"
+)
+
+// Builds an image of runs of random colors with random lengths, plus runs of black pixels at the
+// given positions. Runs are what the assignment cache shortcuts, and black is the color that an
+// empty cache key resembles.
+func makeRunImage(numPixels int, blackRuns [][2]int, rng *rand.Rand) []uint8 {
+	rgba := make([]uint8, numPixels*4)
+	for i := 0; i < numPixels; {
+		r, g, b := uint8(rng.Intn(256)), uint8(rng.Intn(256)), uint8(rng.Intn(256))
+		end := i + 1 + rng.Intn(600)
+		for ; i < end && i < numPixels; i++ {
+			rgba[i*4+0], rgba[i*4+1], rgba[i*4+2], rgba[i*4+3] = r, g, b, 0xff
+		}
+	}
+	for _, run := range blackRuns {
+		for i := run[0]; i < run[1]; i++ {
+			rgba[i*4+0], rgba[i*4+1], rgba[i*4+2] = 0, 0, 0
+		}
+	}
+	return rgba
+}
+
+// The assignment cache must produce exactly the labels of the uncached search
+func TestAssignmentCacheMatchesUncached(t *testing.T) {
+	// With 1 thread, 100000 pixels are split into 4 chunks of 25008 and with 4 threads into 16
+	// chunks of 6256. Each chunk starts a new cache, which assigns 256-pixel blocks.
+	const numPixels = 100000
+	blackRuns := [][2]int{
+		{0, 7},         // a new cache's first pixels
+		{250, 262},     // across a block edge
+		{25000, 25020}, // across a 1-thread chunk edge
+		{25008, 25012}, // starting exactly at a 1-thread chunk edge
+		{50016, 50020},
+		{6250, 6270}, // across 4-thread chunk edges
+		{12510, 12520},
+	}
+	rng := rand.New(rand.NewSource(1))
+	rgba := makeRunImage(numPixels, blackRuns, rng)
+	for _, numThreads := range []int{1, 4} {
+		for seed := uint32(1); seed <= 8; seed++ {
+			image, palette, err := posterizeRGBA(rgba, seed, numThreads, false)
+			if err != nil {
+				t.Fatal(err)
+			}
+			cachedImage, cachedPalette, err := posterizeRGBA(rgba, seed, numThreads, true)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if !bytes.Equal(image, cachedImage) || !bytes.Equal(palette, cachedPalette) {
+				t.Errorf("seed %d, %d threads: cached result differs from uncached", seed, numThreads)
+			}
+		}
+	}
+}
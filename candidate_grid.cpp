@@ -0,0 +1,191 @@
+/*
+ * candidate_grid.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Exact nearest-centroid search through per-cell candidate lists. For a cell, let near(j) be the
+ * distance from centroid j to the closest color in the cell and far(j) the distance to the farthest
+ * one, and let bound be the smallest far(j). Every color in the cell is within bound of some
+ * centroid, so a centroid with near(j) > bound is strictly farther than that one from every color
+ * in the cell and can be dropped. The remaining candidates are kept in index order and searched
+ * with the same keys as the brute-force kernels, so ties still go to the lowest index. Because the
+ * metrics are sums of per-channel terms, near and far are sums of per-channel terms as well.
+ */
+
+#include "candidate_grid.h"
+#include <algorithm>
+
+// Nearest and farthest weighted squared distances along one channel from coordinate c to the colors
+// [lo, lo + side)
+static inline void channelDistanceRange(uint32_t *nearest, uint32_t *farthest, int32_t c, int32_t lo, int32_t side, uint32_t weight)
+{
+    int32_t hi = lo + side - 1;
+    int32_t outside = std::max(std::max(lo - c, c - hi), 0);
+    int32_t across = std::max(c - lo, hi - c);
+    *nearest = weight * uint32_t(outside * outside);
+    *farthest = weight * uint32_t(across * across);
+}
+
+CandidateGrid::CandidateGrid(const uint8_t *rgba, size_t numPoints, const Workers &workers)
+    : m_numPoints(numPoints)
+{
+    PixelChunks chunks(numPoints, workers.numThreads);
+    std::vector<uint32_t> chunkCounts(chunks.count() * kNumCells, 0);
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        uint32_t *counts = &chunkCounts[chunk * kNumCells];
+        const uint8_t *pixel = &rgba[chunks.begin(chunk) * 4];
+        for (size_t i = 0; i < chunks.size(chunk); i++, pixel += 4)
+        {
+            counts[cellOf(pixel[0], pixel[1], pixel[2])]++;
+        }
+    });
+    for (size_t chunk = 0; chunk < chunks.count(); chunk++)
+    {
+        for (size_t cell = 0; cell < kNumCells; cell++)
+        {
+            m_pointCount[cell] += chunkCounts[chunk * kNumCells + cell];
+        }
+    }
+}
+
+template <typename Metric>
+void CandidateGrid::buildPlane(std::vector<Candidate> *candidates, size_t r, const Candidate centroids[], size_t numCentroids)
+{
+    constexpr int32_t side = int32_t(1) << kCellShift;
+
+    // Per-channel terms: red for this plane, green and blue for every cell coordinate
+    std::vector<uint32_t> nearR(numCentroids), farR(numCentroids);
+    std::vector<uint32_t> nearG(kCellsPerChannel * numCentroids), farG(kCellsPerChannel * numCentroids);
+    std::vector<uint32_t> nearB(kCellsPerChannel * numCentroids), farB(kCellsPerChannel * numCentroids);
+    for (size_t j = 0; j < numCentroids; j++)
+    {
+        channelDistanceRange(&nearR[j], &farR[j], centroids[j].color.r, int32_t(r) * side, side, Metric::kWeightR);
+    }
+    for (size_t coordinate = 0; coordinate < kCellsPerChannel; coordinate++)
+    {
+        int32_t lo = int32_t(coordinate) * side;
+        for (size_t j = 0; j < numCentroids; j++)
+        {
+            size_t i = coordinate * numCentroids + j;
+            channelDistanceRange(&nearG[i], &farG[i], centroids[j].color.g, lo, side, Metric::kWeightG);
+            channelDistanceRange(&nearB[i], &farB[i], centroids[j].color.b, lo, side, Metric::kWeightB);
+        }
+    }
+
+    candidates->clear();
+    std::vector<uint32_t> nearest(numCentroids);
+    for (size_t g = 0; g < kCellsPerChannel; g++)
+    {
+        for (size_t b = 0; b < kCellsPerChannel; b++)
+        {
+            const uint32_t *nearGRow = &nearG[g * numCentroids];
+            const uint32_t *farGRow = &farG[g * numCentroids];
+            const uint32_t *nearBRow = &nearB[b * numCentroids];
+            const uint32_t *farBRow = &farB[b * numCentroids];
+            uint32_t bound = UINT32_MAX;
+            for (size_t j = 0; j < numCentroids; j++)
+            {
+                nearest[j] = nearR[j] + nearGRow[j] + nearBRow[j];
+                bound = std::min(bound, farR[j] + farGRow[j] + farBRow[j]);
+            }
+
+            size_t cell = (r << (2 * kCellBits)) | (g << kCellBits) | b;
+            m_cellStart[cell] = uint32_t(candidates->size());
+            for (size_t j = 0; j < numCentroids; j++)
+            {
+                if (nearest[j] <= bound)
+                {
+                    candidates->push_back(centroids[j]);
+                }
+            }
+            m_cellSize[cell] = uint16_t(candidates->size() - m_cellStart[cell]);
+        }
+    }
+}
+
+void CandidateGrid::build(const Centroid centroids[], size_t numCentroids, posterize_metric metric, const Workers &workers)
+{
+    m_metric = metric;
+
+    // Identical centroids (empty clusters all become black, for instance) would each survive as
+    // candidates. Only the lowest index of each can ever be nearest, so keep just that one.
+    std::vector<Candidate> distinctCentroids;
+    distinctCentroids.reserve(numCentroids);
+    for (size_t k = 0; k < numCentroids; k++)
+    {
+        const Centroid &c = centroids[k];
+        bool isDuplicate = std::any_of(distinctCentroids.begin(), distinctCentroids.end(), [&](const Candidate &candidate)
+        {
+            return candidate.color.r == c.r && candidate.color.g == c.g && candidate.color.b == c.b;
+        });
+        if (!isDuplicate)
+        {
+            distinctCentroids.push_back(Candidate{ c, uint8_t(k) });
+        }
+    }
+
+    workers.parallelFor(kCellsPerChannel, [&](size_t r)
+    {
+        if (metric == POSTERIZE_METRIC_LUMA_WEIGHTED_RGB)
+        {
+            buildPlane<LumaWeightedSquaredEuclidean>(&m_planeCandidates[r], r, distinctCentroids.data(), distinctCentroids.size());
+        }
+        else
+        {
+            buildPlane<SquaredEuclidean>(&m_planeCandidates[r], r, distinctCentroids.data(), distinctCentroids.size());
+        }
+    });
+
+    // Concatenate the planes' lists
+    m_candidates.clear();
+    constexpr size_t cellsPerPlane = kNumCells / kCellsPerChannel;
+    for (size_t r = 0; r < kCellsPerChannel; r++)
+    {
+        for (size_t cell = r * cellsPerPlane; cell < (r + 1) * cellsPerPlane; cell++)
+        {
+            m_cellStart[cell] += uint32_t(m_candidates.size());
+        }
+        m_candidates.insert(m_candidates.end(), m_planeCandidates[r].begin(), m_planeCandidates[r].end());
+    }
+
+    uint64_t totalCandidates = 0;
+    for (size_t cell = 0; cell < kNumCells; cell++)
+    {
+        totalCandidates += uint64_t(m_pointCount[cell]) * m_cellSize[cell];
+    }
+    m_isSelective = totalCandidates <= uint64_t(kMaxMeanCandidates) * m_numPoints;
+}
+
+template <typename Metric>
+bool CandidateGrid::assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels) const
+{
+    // Same keys as the brute-force kernels for the largest cluster count
+    constexpr unsigned shiftAmount = indexBits<kMaxCentroids>();
+    bool didChange = false;
+    for (size_t i = 0; i < numPixels; i++)
+    {
+        uint8_t r = rgba[i * 4 + 0];
+        uint8_t g = rgba[i * 4 + 1];
+        uint8_t b = rgba[i * 4 + 2];
+        size_t cell = cellOf(r, g, b);
+        const Candidate *candidates = &m_candidates[m_cellStart[cell]];
+        uint32_t best = UINT32_MAX;
+        for (size_t j = 0; j < m_cellSize[cell]; j++)
+        {
+            best = std::min(best, (colorDistance<Metric>(candidates[j].color, r, g, b) << shiftAmount) | candidates[j].index);
+        }
+        uint8_t k = uint8_t(best);
+        didChange |= labels[i] != k;
+        labels[i] = k;
+    }
+    return didChange;
+}
+
+bool CandidateGrid::assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels) const
+{
+    if (m_metric == POSTERIZE_METRIC_LUMA_WEIGHTED_RGB)
+    {
+        return assignPixels<LumaWeightedSquaredEuclidean>(labels, rgba, numPixels);
+    }
+    return assignPixels<SquaredEuclidean>(labels, rgba, numPixels);
+}
@@ -0,0 +1,94 @@
+/*
+ * candidate_grid.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Exact nearest-centroid search for large palettes. RGB space is divided into a grid of cells and
+ * each cell keeps the list of centroids that can be nearest to some color inside it, so that a
+ * pixel is compared only against its cell's few candidates rather than every centroid.
+ */
+
+#ifndef CANDIDATE_GRID_H
+#define CANDIDATE_GRID_H
+
+#include "kmeans.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Candidate lists for one set of points, rebuilt for each set of centroids. Points are counted per
+// cell up front so that the grid can tell whether it will beat the brute-force kernels.
+class CandidateGrid
+{
+public:
+    // Whether searching a grid can beat the brute-force kernels for assigning numPoints points to
+    // numCentroids centroids, including the cost of building the grid
+    static bool isWorthwhile(size_t numCentroids, size_t numPoints)
+    {
+        return numCentroids >= kMinCentroids && numPoints >= kMinPoints;
+    }
+
+    // Counts the points in each cell. The grid may then only be used to assign these points, or points
+    // that they are a representative sample of.
+    CandidateGrid(const uint8_t *rgba, size_t numPoints, const Workers &workers);
+
+    // Builds the candidate lists for a set of centroids and a metric. A centroid is a candidate for
+    // a cell unless its distance to the nearest color in the cell exceeds some other centroid's
+    // distance to the farthest color in the cell, in which case it can never be nearest there.
+    void build(const Centroid centroids[], size_t numCentroids, posterize_metric metric, const Workers &workers);
+
+    // Whether the built grid prunes enough centroids, on average over the points, to beat the
+    // brute-force kernels. Centroids bunched together, as after seeding, often leave most of them
+    // candidates where the points are.
+    bool isSelective() const
+    {
+        return m_isSelective;
+    }
+
+    // Assigns pixels like an AssignPixelsFn, with results identical to the brute-force kernels for
+    // the metric
+    bool assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels) const;
+
+private:
+    static constexpr unsigned kCellBits = 4;    // per channel
+    static constexpr unsigned kCellShift = 8 - kCellBits;
+    static constexpr size_t kCellsPerChannel = size_t(1) << kCellBits;
+    static constexpr size_t kNumCells = size_t(1) << (3 * kCellBits);
+
+    // Below 256 centroids the SIMD kernels are about as fast (see the README), and below this many
+    // points building the grid costs more than it saves
+    static constexpr size_t kMinCentroids = 256;
+    static constexpr size_t kMinPoints = 16 * kNumCells;
+
+    // Searching candidates one at a time costs about as much as the AVX2 kernel's search of all 256
+    // centroids at about this many candidates per point
+    static constexpr size_t kMaxMeanCandidates = 20;
+
+    // Centroid color and original index, stored contiguously per cell
+    struct Candidate
+    {
+        Centroid color;
+        uint8_t index;
+    };
+
+    template <typename Metric>
+    void buildPlane(std::vector<Candidate> *candidates, size_t r, const Candidate centroids[], size_t numCentroids);
+
+    template <typename Metric>
+    bool assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels) const;
+
+    static size_t cellOf(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return (size_t(r >> kCellShift) << (2 * kCellBits)) | (size_t(g >> kCellShift) << kCellBits) | size_t(b >> kCellShift);
+    }
+
+    size_t m_numPoints;
+    posterize_metric m_metric = POSTERIZE_METRIC_RGB;
+    bool m_isSelective = false;
+    uint32_t m_pointCount[kNumCells] = {};
+    uint32_t m_cellStart[kNumCells];    // offset of each cell's list in m_candidates
+    uint16_t m_cellSize[kNumCells];
+    std::vector<Candidate> m_candidates;
+    std::vector<Candidate> m_planeCandidates[kCellsPerChannel];
+};
+
+#endif // CANDIDATE_GRID_H
@@ -0,0 +1,48 @@
+package main
+
+import "testing"
+
+// Squared RGB distance from pixel i to palette color k
+func paletteDistance(rgba []uint8, i int, palette []uint8, k int) int {
+	dr := int(rgba[i*4+0]) - int(palette[k*3+0])
+	dg := int(rgba[i*4+1]) - int(palette[k*3+1])
+	db := int(rgba[i*4+2]) - int(palette[k*3+2])
+	return dr*dr + dg*dg + db*db
+}
+
+// The darkest color is forced to black and swapped to index 0 after pixels are assigned, so every
+// pixel must be relabeled along with it. A pixel not labeled 0 must therefore still point to the
+// nearest of the other palette colors, which are unchanged centroids.
+func TestDarkestColorRelabeling(t *testing.T) {
+	img, err := decodeJPEG("bouquet.jpg")
+	if err != nil {
+		t.Fatal(err)
+	}
+	rgba := imageToLinearRGBA(img)
+	for seed := uint32(1); seed <= 4; seed++ {
+		image, palette, err := posterizeRGBA(rgba, seed, 0, false)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if palette[0] != 0 || palette[1] != 0 || palette[2] != 0 {
+			t.Fatalf("seed %d: color 0 is not black", seed)
+		}
+		numMislabeled := 0
+		for i := 0; i < len(rgba)/4; i++ {
+			label := int(image[i/2]>>(4*(1-i%2))) & 0xf
+			if label == 0 {
+				continue
+			}
+			distance := paletteDistance(rgba, i, palette, label)
+			for k := 1; k < 16; k++ {
+				if paletteDistance(rgba, i, palette, k) < distance {
+					numMislabeled++
+					break
+				}
+			}
+		}
+		if numMislabeled != 0 {
+			t.Errorf("seed %d: %d pixels do not point to their nearest color", seed, numMislabeled)
+		}
+	}
+}
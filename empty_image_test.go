@@ -0,0 +1,24 @@
+package main
+
+import "testing"
+
+// Images with no pixels succeed with an all-black palette in every pixel format, including those
+// that are converted row by row
+func TestEmptyImage(t *testing.T) {
+	sizes := [][2]int{{0, 0}, {0, 4}, {5, 0}}
+	for format := range pixelFormats {
+		for _, size := range sizes {
+			palette, err := posterizeEmptyImage(format, size[0], size[1])
+			if err != nil {
+				t.Errorf("%s %dx%d: %v", format, size[0], size[1], err)
+				continue
+			}
+			for _, value := range palette {
+				if value != 0 {
+					t.Errorf("%s %dx%d: palette is not black", format, size[0], size[1])
+					break
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,218 @@
+/*
+ * hamerly.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * k-means accelerated with Hamerly's triangle-inequality bounds. See: G. Hamerly, "Making k-means
+ * even faster", SDM 2010.
+ *
+ * Each pixel keeps an upper bound on the distance to its assigned centroid and a lower bound on the
+ * distance to every other centroid. When centroids move, the bounds are loosened by the distance
+ * moved. A pixel cannot change clusters if its upper bound is below both its lower bound and half
+ * the distance from its centroid to the nearest other centroid, in which case no distances need to
+ * be computed at all.
+ *
+ * To reproduce plain k-means exactly, including ties going to the lowest cluster index, pixels are
+ * only skipped when the bounds prove that the assigned centroid is strictly nearest, with a margin
+ * that covers floating point rounding in the bounds.
+ */
+
+#include "hamerly.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+// Per-pixel bounds on distances (not squared)
+struct Bounds
+{
+    float upper;
+    float lower;
+};
+
+// Margin by which a pixel's upper bound must undercut its lower bound to be skipped. This covers
+// float rounding in the bounds, which include cumulative drifts of up to a few thousand (442 per
+// iteration at most) where rounding error is around 1e-4 per operation.
+static constexpr float kBoundsMargin = 1e-2f;
+
+static inline uint32_t distanceSquared(const uint8_t *pixel, const Centroid &centroid)
+{
+    int32_t dr = int32_t(centroid.r) - pixel[0];
+    int32_t dg = int32_t(centroid.g) - pixel[1];
+    int32_t db = int32_t(centroid.b) - pixel[2];
+    return uint32_t(dr * dr + dg * dg + db * db);
+}
+
+static inline float distance(const Centroid &a, const Centroid &b)
+{
+    int32_t dr = int32_t(a.r) - b.r;
+    int32_t dg = int32_t(a.g) - b.g;
+    int32_t db = int32_t(a.b) - b.b;
+    return std::sqrt(float(dr * dr + dg * dg + db * db));
+}
+
+KMeansResult runKMeansHamerly(Centroid centroids[], size_t numCentroids, Labels labels, const uint8_t *rgba, size_t numPixels, const KMeansLimits &limits, const Workers &workers, ScratchArena &scratch)
+{
+    Bounds *bounds = scratch.allocate<Bounds>(numPixels);   // initialized by the first iteration
+    FindNearestTwoFn findNearestTwo = getFindNearestTwoKernel(numCentroids);
+    unsigned keyShift = 0;
+    while ((size_t(1) << keyShift) < numCentroids)
+    {
+        keyShift++;
+    }
+
+    // Cluster sums are maintained incrementally: each chunk records how the pixels that changed
+    // clusters altered them. Unsigned wraparound makes subtraction work out exactly.
+    PixelChunks chunks(numPixels, workers.numThreads);
+    std::vector<ClusterSums> chunkDeltas(chunks.count());
+    std::vector<size_t> chunkNumChanged(chunks.count());
+    Color sums[kMaxCentroids];
+    size_t counts[kMaxCentroids] = {};
+
+    // Bounds are stored relative to the cumulative distance each centroid has moved (and the
+    // cumulative maximum over all centroids) so that loosening them as centroids move is free: a
+    // pixel's bounds are only written when they are tightened or recomputed.
+    double clusterDrift[kMaxCentroids] = {};
+    double maxDrift = 0;
+    float halfSeparation[kMaxCentroids];    // half the distance to the nearest other centroid
+    KMeansResult result = { .iterations = 0, .stopReason = POSTERIZE_STOP_CONVERGED };
+    while (true)
+    {
+        std::chrono::steady_clock::time_point iterationStart = std::chrono::steady_clock::now();
+
+        // Inter-centroid distances and drifts as of this iteration
+        for (size_t j = 0; j < numCentroids; j++)
+        {
+            float nearest = INFINITY;
+            for (size_t k = 0; k < numCentroids; k++)
+            {
+                if (k != j)
+                {
+                    nearest = std::min(nearest, distance(centroids[j], centroids[k]));
+                }
+            }
+            halfSeparation[j] = 0.5f * nearest;
+        }
+        float upperDrift[kMaxCentroids];
+        for (size_t k = 0; k < numCentroids; k++)
+        {
+            upperDrift[k] = float(clusterDrift[k]);
+        }
+        float lowerDrift = float(maxDrift);
+
+        // Assign. Pixels are processed in blocks: the bounds test is applied to each pixel and the
+        // ones that fail it are gathered and searched together with a SIMD kernel.
+        bool isFirstIteration = result.iterations == 0;
+        workers.parallelFor(chunks.count(), [&](size_t chunk)
+        {
+            constexpr size_t blockSize = 256;
+            uint32_t candidates[blockSize];
+            uint8_t candidatePixels[blockSize * 4];
+            uint32_t nearestKeys[blockSize];
+            uint32_t secondNearestKeys[blockSize];
+
+            ClusterSums &deltas = chunkDeltas[chunk];
+            deltas = ClusterSums();
+            size_t numChanged = 0;
+            size_t chunkEnd = chunks.begin(chunk) + chunks.size(chunk);
+            for (size_t blockStart = chunks.begin(chunk); blockStart < chunkEnd; blockStart += blockSize)
+            {
+                size_t blockEnd = std::min(blockStart + blockSize, chunkEnd);
+                size_t numCandidates = 0;
+                for (size_t i = blockStart; i < blockEnd; i++)
+                {
+                    const uint8_t *pixel = &rgba[i * 4];
+                    Bounds &b = bounds[i];
+                    if (!isFirstIteration)
+                    {
+                        uint8_t k = labels.get(i);
+                        float upper = b.upper + upperDrift[k];
+                        float threshold = std::max(b.lower - lowerDrift, halfSeparation[k]) - kBoundsMargin;
+                        if (upper < threshold)
+                        {
+                            continue;
+                        }
+
+                        // Tighten upper bound and test again before searching all centroids
+                        upper = std::sqrt(float(distanceSquared(pixel, centroids[k])));
+                        if (upper < threshold)
+                        {
+                            b.upper = upper - upperDrift[k];
+                            continue;
+                        }
+                    }
+                    memcpy(&candidatePixels[numCandidates * 4], pixel, 4);
+                    candidates[numCandidates++] = uint32_t(i - blockStart);
+                }
+
+                findNearestTwo(nearestKeys, secondNearestKeys, candidatePixels, numCandidates, centroids);
+
+                for (size_t j = 0; j < numCandidates; j++)
+                {
+                    size_t i = blockStart + candidates[j];
+                    const uint8_t *pixel = &rgba[i * 4];
+                    uint8_t newK = uint8_t(nearestKeys[j] & (numCentroids - 1));
+                    bounds[i].upper = std::sqrt(float(nearestKeys[j] >> keyShift)) - upperDrift[newK];
+                    bounds[i].lower = std::sqrt(float(secondNearestKeys[j] >> keyShift)) + lowerDrift;
+                    uint8_t k = labels.get(i);
+                    if (!isFirstIteration && newK == k)
+                    {
+                        continue;
+                    }
+                    if (!isFirstIteration)
+                    {
+                        deltas.color[k].r -= pixel[0];
+                        deltas.color[k].g -= pixel[1];
+                        deltas.color[k].b -= pixel[2];
+                        deltas.count[k]--;
+                        numChanged++;
+                    }
+                    deltas.color[newK].r += pixel[0];
+                    deltas.color[newK].g += pixel[1];
+                    deltas.color[newK].b += pixel[2];
+                    deltas.count[newK]++;
+                    labels.set(i, newK);
+                }
+            }
+            chunkNumChanged[chunk] = numChanged;
+        });
+        size_t numChanged = std::accumulate(chunkNumChanged.begin(), chunkNumChanged.end(), size_t(0));
+        result.iterations++;
+        if (limits.shouldStop(&result.stopReason, result.iterations, isFirstIteration || numChanged != 0, numChanged, numPixels, iterationStart))
+        {
+            break;
+        }
+
+        // Update centroids from the incrementally maintained sums
+        for (const ClusterSums &deltas : chunkDeltas)
+        {
+            for (size_t k = 0; k < numCentroids; k++)
+            {
+                sums[k].r += deltas.color[k].r;
+                sums[k].g += deltas.color[k].g;
+                sums[k].b += deltas.color[k].b;
+                counts[k] += deltas.count[k];
+            }
+        }
+        Centroid previous[kMaxCentroids];
+        std::copy(centroids, centroids + numCentroids, previous);
+        computeCentroids(centroids, numCentroids, sums, counts);
+        if (limits.hasSettled(previous, centroids, numCentroids))
+        {
+            // Labels were assigned against the previous centroids
+            std::copy(previous, previous + numCentroids, centroids);
+            result.stopReason = POSTERIZE_STOP_TOLERANCE;
+            break;
+        }
+        float mostMoved = 0;
+        for (size_t k = 0; k < numCentroids; k++)
+        {
+            float moved = distance(previous[k], centroids[k]);
+            clusterDrift[k] += moved;
+            mostMoved = std::max(mostMoved, moved);
+        }
+        maxDrift += mostMoved;
+    }
+    return result;
+}
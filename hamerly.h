@@ -0,0 +1,21 @@
+/*
+ * hamerly.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * k-means accelerated with Hamerly's triangle-inequality bounds.
+ */
+
+#ifndef HAMERLY_H
+#define HAMERLY_H
+
+#include "kmeans.h"
+#include "scratch_arena.h"
+#include <cstddef>
+#include <cstdint>
+
+// Same contract and results as runKMeans() with unweighted points, but most pixels skip the
+// distance computation once centroids settle. Requires 8 bytes of scratch memory per pixel for the
+// bounds.
+extern KMeansResult runKMeansHamerly(Centroid centroids[], size_t numCentroids, Labels labels, const uint8_t *rgba, size_t numPixels, const KMeansLimits &limits, const Workers &workers, ScratchArena &scratch);
+
+#endif // HAMERLY_H
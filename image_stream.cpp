@@ -0,0 +1,136 @@
+/*
+ * image_stream.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Images read a band of rows at a time through a callback, and k-means passes over them.
+ */
+
+#include "image_stream.h"
+#include "candidate_grid.h"
+#include "input_image.h"
+#include <cstring>
+#include <memory>
+
+// Default band size in pixels: large enough that each band keeps every thread busy, small enough
+// that a converted band fits in a few megabytes
+constexpr size_t kBandPixels = size_t(1) << 20;
+
+// Bands are a multiple of this many rows, so that they start on byte boundaries of packed images
+// and on chroma rows of 4:2:0 images
+constexpr size_t kBandRowMultiple = 8;
+
+bool ImageStream::isValid(const posterize_stream &stream)
+{
+    if (!stream.readRows || stream.width == 0 || stream.height == 0)
+    {
+        return false;
+    }
+    return stream.width <= SIZE_MAX / 4 / stream.height;
+}
+
+ImageStream::ImageStream(const posterize_stream &stream, ScratchArena &scratch)
+    : m_stream(stream),
+      m_scratch(scratch)
+{
+    size_t bandHeight = stream.bandHeight != 0 ? stream.bandHeight : std::max(kBandPixels / stream.width, size_t(1));
+    m_bandHeight = std::min((bandHeight + kBandRowMultiple - 1) / kBandRowMultiple * kBandRowMultiple, (stream.height + kBandRowMultiple - 1) / kBandRowMultiple * kBandRowMultiple);
+}
+
+const uint8_t *ImageStream::read(size_t band, const Workers &workers)
+{
+    size_t firstRow = band * m_bandHeight;
+    size_t numRows = std::min(m_bandHeight, m_stream.height - firstRow);
+    posterize_image rows = {};
+    rows.width = m_stream.width;
+    rows.height = numRows;
+    if (m_stream.readRows(m_stream.userData, firstRow, numRows, &rows) != 0)
+    {
+        throw StreamReadError();
+    }
+    if (rows.width != m_stream.width || rows.height != numRows || !InputImage::isValid(rows))
+    {
+        throw StreamReadError();
+    }
+
+    InputImage input(rows);
+    if (input.rgba())
+    {
+        return input.rgba();
+    }
+    if (!m_band)
+    {
+        m_band = m_scratch.allocate<uint8_t>(m_bandHeight * m_stream.width * 4);
+    }
+    input.convertParallel(m_band, 0, input.numPixels(), workers);
+    return m_band;
+}
+
+uint8_t *sampleStream(ImageStream &stream, size_t numSamples, const Workers &workers, ScratchArena &scratch)
+{
+    uint8_t *samples = scratch.allocate<uint8_t>(numSamples * 4);
+    size_t numPixels = stream.numPixels();
+    size_t i = 0;
+    for (size_t band = 0; band < stream.numBands() && i < numSamples; band++)
+    {
+        const uint8_t *rgba = stream.read(band, workers);
+        size_t bandEnd = stream.bandStart(band) + stream.bandPixels(band);
+        for (; i < numSamples; i++)
+        {
+            size_t pixel = i * numPixels / numSamples;
+            if (pixel >= bandEnd)
+            {
+                break;
+            }
+            memcpy(&samples[i * 4], &rgba[(pixel - stream.bandStart(band)) * 4], 4);
+        }
+    }
+    return samples;
+}
+
+KMeansResult runStreamingKMeans(Centroid centroids[], size_t numCentroids, Labels labels, ImageStream &stream, const uint8_t *samples, size_t numSamples, const KMeansLimits &limits, const Workers &workers, posterize_metric metric)
+{
+    std::unique_ptr<CandidateGrid> grid;
+    if (CandidateGrid::isWorthwhile(numCentroids, stream.numPixels()))
+    {
+        grid = std::make_unique<CandidateGrid>(samples, numSamples, workers);
+    }
+
+    // Repeat k-means until complete, summing clusters over all bands before computing centroids
+    std::unique_ptr<ClusterSums> sums = std::make_unique<ClusterSums>();
+    KMeansResult result = { .iterations = 0, .stopReason = POSTERIZE_STOP_CONVERGED };
+    while (true)
+    {
+        std::chrono::steady_clock::time_point iterationStart = std::chrono::steady_clock::now();
+        const CandidateGrid *activeGrid = nullptr;
+        if (grid)
+        {
+            grid->build(centroids, numCentroids, metric, workers);
+            activeGrid = grid->isSelective() ? grid.get() : nullptr;
+        }
+
+        *sums = ClusterSums();
+        bool didChange = false;
+        size_t numChanged = 0;
+        size_t *numChangedIfCounted = limits.countsChanges() && result.iterations > 0 ? &numChanged : nullptr;
+        for (size_t band = 0; band < stream.numBands(); band++)
+        {
+            const uint8_t *rgba = stream.read(band, workers);
+            Labels bandLabels{ labels.byteAt(stream.bandStart(band)), labels.bitsPerLabel };
+            didChange |= assignAndSumParallel(sums.get(), numChangedIfCounted, bandLabels, rgba, stream.bandPixels(band), centroids, numCentroids, activeGrid, workers, metric);
+        }
+        result.iterations++;
+        if (limits.shouldStop(&result.stopReason, result.iterations, didChange, numChanged, stream.numPixels(), iterationStart))
+        {
+            break;
+        }
+        Centroid next[kMaxCentroids];
+        computeCentroids(next, numCentroids, sums->color, sums->count);
+        if (limits.hasSettled(centroids, next, numCentroids))
+        {
+            result.stopReason = POSTERIZE_STOP_TOLERANCE;
+            break;
+        }
+        std::copy(next, next + numCentroids, centroids);
+    }
+    return result;
+}
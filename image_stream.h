@@ -0,0 +1,82 @@
+/*
+ * image_stream.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Images read a band of rows at a time through a callback, and k-means passes over them. Only one
+ * band is held in memory at a time, and only if it has to be converted to RGBA.
+ */
+
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include "posterize.h"
+#include "kmeans.h"
+#include "scratch_arena.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+// Thrown when the callback fails or describes its rows incorrectly
+class StreamReadError : public std::exception
+{
+public:
+    const char *what() const noexcept override
+    {
+        return "failed to read rows of a streamed image";
+    }
+};
+
+class ImageStream
+{
+public:
+    // Whether a stream description is complete: a callback and a non-empty image small enough for
+    // its pixels to be counted
+    static bool isValid(const posterize_stream &stream);
+
+    // The description must be valid. The band buffer, if needed, is allocated from scratch.
+    ImageStream(const posterize_stream &stream, ScratchArena &scratch);
+
+    size_t numPixels() const
+    {
+        return m_stream.width * m_stream.height;
+    }
+
+    // Bands hold a multiple of 8 pixels, except the last, so that each starts on a byte boundary of
+    // a packed image at any depth
+    size_t numBands() const
+    {
+        return (m_stream.height + m_bandHeight - 1) / m_bandHeight;
+    }
+
+    size_t bandStart(size_t band) const
+    {
+        return band * m_bandHeight * m_stream.width;
+    }
+
+    size_t bandPixels(size_t band) const
+    {
+        return std::min(m_bandHeight, m_stream.height - band * m_bandHeight) * m_stream.width;
+    }
+
+    // Reads a band and returns its pixels as RGBA, valid until the next read. Bands in RGBA are read
+    // in place. Throws StreamReadError.
+    const uint8_t *read(size_t band, const Workers &workers);
+
+private:
+    posterize_stream m_stream;
+    size_t m_bandHeight;
+    ScratchArena &m_scratch;
+    uint8_t *m_band = nullptr;
+};
+
+// Reads the whole stream once and returns an RGBA buffer, allocated from scratch, of numSamples
+// evenly spaced pixels
+extern uint8_t *sampleStream(ImageStream &stream, size_t numSamples, const Workers &workers, ScratchArena &scratch);
+
+// Same as runKMeans() but for the pixels of a stream, reading every band once per iteration.
+// Large palettes are searched through a CandidateGrid whose cells are counted from a sample of the
+// pixels. Returns the number of iterations performed and why they stopped.
+extern KMeansResult runStreamingKMeans(Centroid centroids[], size_t numCentroids, Labels labels, ImageStream &stream, const uint8_t *samples, size_t numSamples, const KMeansLimits &limits, const Workers &workers, posterize_metric metric);
+
+#endif // IMAGE_STREAM_H
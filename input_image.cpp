@@ -0,0 +1,595 @@
+/*
+ * input_image.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Conversion of input images to RGBA. Each layout and YCbCr range has its own row converter, with
+ * the conversion constants folded in, and an SSE4.1 version where available, with results
+ * identical to the scalar code.
+ */
+
+#include "input_image.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef POSTERIZE_X86
+#include <immintrin.h>
+
+static bool hasSSE41()
+{
+    static const bool supported = []()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+    }();
+    return supported;
+}
+#endif
+
+/*
+ * YCbCr ranges: 16.16 fixed-point coefficients of the BT.601 conversion to RGB.
+ */
+
+// Full range, with exactly the arithmetic of Go's color.YCbCrToRGB() (no rounding, Y scaled by
+// 0x10101 rather than 0x10000)
+struct FullRangeYCbCr
+{
+    static constexpr int32_t kYOffset = 0;
+    static constexpr int32_t kYScale = 0x10101;
+    static constexpr int32_t kRounding = 0;
+    static constexpr int32_t kCrToR = 91881;     // 1.402
+    static constexpr int32_t kCbToG = 22554;     // 0.344136
+    static constexpr int32_t kCrToG = 46802;     // 0.714136
+    static constexpr int32_t kCbToB = 116130;    // 1.772
+};
+
+// Video range: Y scaled from [16, 235] and Cb and Cr from [16, 240]
+struct VideoRangeYCbCr
+{
+    static constexpr int32_t kYOffset = 16;
+    static constexpr int32_t kYScale = 76309;     // 1.164383
+    static constexpr int32_t kRounding = 0x8000;
+    static constexpr int32_t kCrToR = 104597;    // 1.596027
+    static constexpr int32_t kCbToG = 25675;     // 0.391762
+    static constexpr int32_t kCrToG = 53279;     // 0.812968
+    static constexpr int32_t kCbToB = 132201;    // 2.017232
+};
+
+// Contributions of a Cb, Cr pair to R, G, and B, shared by the pixels that the pair covers
+struct ChromaTerms
+{
+    int32_t r;
+    int32_t g;
+    int32_t b;
+};
+
+template <typename Range>
+static inline ChromaTerms chromaTerms(uint8_t cb, uint8_t cr)
+{
+    int32_t cb1 = int32_t(cb) - 128;
+    int32_t cr1 = int32_t(cr) - 128;
+    return { Range::kCrToR * cr1, -Range::kCbToG * cb1 - Range::kCrToG * cr1, Range::kCbToB * cb1 };
+}
+
+static inline uint8_t clampToByte(int32_t value)
+{
+    return uint8_t(std::clamp(value >> 16, 0, 255));
+}
+
+template <typename Range>
+static inline void writePixel(uint8_t *pixel, uint8_t y, const ChromaTerms &chroma)
+{
+    int32_t yy = (int32_t(y) - Range::kYOffset) * Range::kYScale + Range::kRounding;
+    pixel[0] = clampToByte(yy + chroma.r);
+    pixel[1] = clampToByte(yy + chroma.g);
+    pixel[2] = clampToByte(yy + chroma.b);
+    pixel[3] = 0xff;
+}
+
+/*
+ * Chroma samples of a row: Cb and Cr of pixel i, from separate planes or from interleaved pairs, each
+ * sample covering 2^kShift pixels horizontally.
+ */
+
+template <unsigned Shift>
+struct PlanarChroma
+{
+    static constexpr unsigned kShift = Shift;
+    const uint8_t *cbRow;
+    const uint8_t *crRow;
+
+    uint8_t cb(size_t i) const
+    {
+        return cbRow[i >> kShift];
+    }
+
+    uint8_t cr(size_t i) const
+    {
+        return crRow[i >> kShift];
+    }
+};
+
+struct InterleavedChroma
+{
+    static constexpr unsigned kShift = 1;
+    const uint8_t *pairRow;
+
+    uint8_t cb(size_t i) const
+    {
+        return pairRow[(i >> 1) * 2 + 0];
+    }
+
+    uint8_t cr(size_t i) const
+    {
+        return pairRow[(i >> 1) * 2 + 1];
+    }
+};
+
+#ifdef POSTERIZE_X86
+
+/*
+ * SSE4.1: 8 pixels per loop iteration, in 32-bit lanes with the same arithmetic as the scalar code.
+ * After the shift, every channel value fits in 16 bits, so saturating packs to 16 and then 8 bits
+ * clamp exactly like the scalar code. The packed channels are then interleaved into RGBA.
+ */
+
+// Loads the Cb and Cr samples of pixels [i, i + 8) into 32-bit lanes, pixels i to i + 3 in [0] and
+// i + 4 to i + 7 in [1]. For subsampled chroma, i must be even.
+template <unsigned Shift>
+__attribute__((target("sse4.1")))
+static inline void loadChromaSSE41(__m128i cb[2], __m128i cr[2], const PlanarChroma<Shift> &chroma, size_t i)
+{
+    const uint8_t *rows[2] = { chroma.cbRow, chroma.crRow };
+    __m128i *lanes[2] = { cb, cr };
+    for (size_t c = 0; c < 2; c++)
+    {
+        if constexpr (Shift == 0)
+        {
+            __m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&rows[c][i]));
+            lanes[c][0] = _mm_cvtepu8_epi32(samples);
+            lanes[c][1] = _mm_cvtepu8_epi32(_mm_srli_si128(samples, 4));
+        }
+        else
+        {
+            int32_t samples;
+            memcpy(&samples, &rows[c][i >> 1], 4);
+            __m128i wide = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(samples));
+            lanes[c][0] = _mm_unpacklo_epi32(wide, wide);
+            lanes[c][1] = _mm_unpackhi_epi32(wide, wide);
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline void loadChromaSSE41(__m128i cb[2], __m128i cr[2], const InterleavedChroma &chroma, size_t i)
+{
+    __m128i pairs = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&chroma.pairRow[i]));
+    __m128i cbWide = _mm_cvtepu8_epi32(_mm_shuffle_epi8(pairs, _mm_setr_epi8(0, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+    __m128i crWide = _mm_cvtepu8_epi32(_mm_shuffle_epi8(pairs, _mm_setr_epi8(1, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+    cb[0] = _mm_unpacklo_epi32(cbWide, cbWide);
+    cb[1] = _mm_unpackhi_epi32(cbWide, cbWide);
+    cr[0] = _mm_unpacklo_epi32(crWide, crWide);
+    cr[1] = _mm_unpackhi_epi32(crWide, crWide);
+}
+
+// Converts pixels [i, end) 8 at a time and returns the index of the first pixel left for scalar
+// code. For subsampled chroma, i must be even.
+template <typename Range, typename Chroma>
+__attribute__((target("sse4.1")))
+static size_t convertRowSSE41(uint8_t *rgba, const uint8_t *lumaRow, const Chroma &chroma, size_t i, size_t end)
+{
+    const __m128i yScale = _mm_set1_epi32(Range::kYScale);
+    const __m128i yBias = _mm_set1_epi32(Range::kRounding - Range::kYOffset * Range::kYScale);
+    const __m128i chromaOffset = _mm_set1_epi32(128);
+    const __m128i crToR = _mm_set1_epi32(Range::kCrToR);
+    const __m128i cbToG = _mm_set1_epi32(Range::kCbToG);
+    const __m128i crToG = _mm_set1_epi32(Range::kCrToG);
+    const __m128i cbToB = _mm_set1_epi32(Range::kCbToB);
+    const __m128i alpha = _mm_set1_epi16(0xff);
+    for (; i + 8 <= end; i += 8, rgba += 32)
+    {
+        __m128i cb[2];
+        __m128i cr[2];
+        loadChromaSSE41(cb, cr, chroma, i);
+        __m128i luma = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&lumaRow[i]));
+        __m128i r[2];
+        __m128i g[2];
+        __m128i b[2];
+        for (size_t half = 0; half < 2; half++)
+        {
+            __m128i yy = _mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu8_epi32(half ? _mm_srli_si128(luma, 4) : luma), yScale), yBias);
+            __m128i cb1 = _mm_sub_epi32(cb[half], chromaOffset);
+            __m128i cr1 = _mm_sub_epi32(cr[half], chromaOffset);
+            r[half] = _mm_srai_epi32(_mm_add_epi32(yy, _mm_mullo_epi32(cr1, crToR)), 16);
+            g[half] = _mm_srai_epi32(_mm_sub_epi32(yy, _mm_add_epi32(_mm_mullo_epi32(cb1, cbToG), _mm_mullo_epi32(cr1, crToG))), 16);
+            b[half] = _mm_srai_epi32(_mm_add_epi32(yy, _mm_mullo_epi32(cb1, cbToB)), 16);
+        }
+        __m128i rb = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(b[0], b[1]));
+        __m128i ga = _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), alpha);
+        __m128i rg = _mm_unpacklo_epi8(rb, ga);
+        __m128i ba = _mm_unpackhi_epi8(rb, ga);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    return i;
+}
+
+/*
+ * SSE4.1 versions of the packed RGB layouts: 4 pixels per loop iteration, reordered with
+ * _mm_shuffle_epi8().
+ */
+
+// Converts pixels [0, numPixels) and returns the index of the first pixel left for scalar code
+__attribute__((target("sse4.1")))
+static size_t swapRedBlueSSE41(uint8_t *rgba, const uint8_t *bgra, size_t numPixels)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 4 <= numPixels; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&bgra[i * 4]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&rgba[i * 4]), _mm_shuffle_epi8(pixels, order));
+    }
+    return i;
+}
+
+// Converts pixels [0, numPixels) and returns the index of the first pixel left for scalar code.
+// Each iteration loads 16 bytes for 12 bytes of pixels, so it stops 2 pixels early to stay inside
+// the row.
+__attribute__((target("sse4.1")))
+static size_t expandRGB24SSE41(uint8_t *rgba, const uint8_t *rgb, size_t numPixels)
+{
+    const __m128i order = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000));
+    size_t i = 0;
+    for (; i + 6 <= numPixels; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&rgb[i * 3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&rgba[i * 4]), _mm_or_si128(_mm_shuffle_epi8(pixels, order), alpha));
+    }
+    return i;
+}
+
+#endif // POSTERIZE_X86
+
+// Converts count pixels of a row, starting at column x
+template <typename Range, typename Chroma>
+static void convertYCbCrRow(uint8_t *rgba, const uint8_t *lumaRow, const Chroma &chroma, size_t x, size_t count)
+{
+    size_t end = x + count;
+    size_t i = x;
+    auto convertPixel = [&](size_t i)
+    {
+        writePixel<Range>(&rgba[(i - x) * 4], lumaRow[i], chromaTerms<Range>(chroma.cb(i), chroma.cr(i)));
+    };
+
+    // Vectorized code starts on the first pixel of a chroma sample
+    if (Chroma::kShift != 0 && (i & 1) != 0 && i < end)
+    {
+        convertPixel(i++);
+    }
+#ifdef POSTERIZE_X86
+    if (hasSSE41())
+    {
+        i = convertRowSSE41<Range>(&rgba[(i - x) * 4], lumaRow, chroma, i, end);
+    }
+#endif
+    for (; i < end; i++)
+    {
+        convertPixel(i);
+    }
+}
+
+/*
+ * Layouts: each converts count pixels of row y, starting at column x.
+ */
+
+struct LayoutRGBA
+{
+    static void convertRow(uint8_t *rgba, const posterize_image &image, size_t y, size_t x, size_t count)
+    {
+        memcpy(rgba, &image.planes[0][y * image.strides[0] + x * 4], count * 4);
+    }
+};
+
+// B, G, R, A: the red and blue bytes of each pixel are swapped
+struct LayoutBGRA
+{
+    static void convertRow(uint8_t *rgba, const posterize_image &image, size_t y, size_t x, size_t count)
+    {
+        const uint8_t *row = &image.planes[0][y * image.strides[0] + x * 4];
+        size_t i = 0;
+#ifdef POSTERIZE_X86
+        if (hasSSE41())
+        {
+            i = swapRedBlueSSE41(rgba, row, count);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            rgba[i * 4 + 0] = row[i * 4 + 2];
+            rgba[i * 4 + 1] = row[i * 4 + 1];
+            rgba[i * 4 + 2] = row[i * 4 + 0];
+            rgba[i * 4 + 3] = row[i * 4 + 3];
+        }
+    }
+};
+
+// R, G, B without alpha
+struct LayoutRGB24
+{
+    static void convertRow(uint8_t *rgba, const posterize_image &image, size_t y, size_t x, size_t count)
+    {
+        const uint8_t *row = &image.planes[0][y * image.strides[0] + x * 3];
+        size_t i = 0;
+#ifdef POSTERIZE_X86
+        if (hasSSE41())
+        {
+            i = expandRGB24SSE41(rgba, row, count);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            rgba[i * 4 + 0] = row[i * 3 + 0];
+            rgba[i * 4 + 1] = row[i * 3 + 1];
+            rgba[i * 4 + 2] = row[i * 3 + 2];
+            rgba[i * 4 + 3] = 0xff;
+        }
+    }
+};
+
+// Cb and Cr in separate planes, subsampled by 2^ShiftX horizontally and 2^ShiftY vertically
+template <unsigned ShiftX, unsigned ShiftY, typename Range>
+struct LayoutPlanarYCbCr
+{
+    static void convertRow(uint8_t *rgba, const posterize_image &image, size_t y, size_t x, size_t count)
+    {
+        const PlanarChroma<ShiftX> chroma = { &image.planes[1][(y >> ShiftY) * image.strides[1]], &image.planes[2][(y >> ShiftY) * image.strides[2]] };
+        convertYCbCrRow<Range>(rgba, &image.planes[0][y * image.strides[0]], chroma, x, count);
+    }
+};
+
+// Cb, Cr pairs interleaved in one plane, subsampled by 2 in both directions
+template <typename Range>
+struct LayoutNV12
+{
+    static void convertRow(uint8_t *rgba, const posterize_image &image, size_t y, size_t x, size_t count)
+    {
+        const InterleavedChroma chroma = { &image.planes[1][(y >> 1) * image.strides[1]] };
+        convertYCbCrRow<Range>(rgba, &image.planes[0][y * image.strides[0]], chroma, x, count);
+    }
+};
+
+static bool isYCbCr(posterize_pixel_format format)
+{
+    return format == POSTERIZE_PIXEL_FORMAT_I420 || format == POSTERIZE_PIXEL_FORMAT_I422 || format == POSTERIZE_PIXEL_FORMAT_I444 || format == POSTERIZE_PIXEL_FORMAT_NV12;
+}
+
+// Bytes in a row of a plane, or 0 if the format does not use the plane
+static size_t planeRowBytes(const posterize_image &image, size_t plane)
+{
+    size_t halfWidth = (image.width + 1) / 2;
+    switch (image.format)
+    {
+    case POSTERIZE_PIXEL_FORMAT_RGBA:
+    case POSTERIZE_PIXEL_FORMAT_BGRA:
+        return plane == 0 ? image.width * 4 : 0;
+    case POSTERIZE_PIXEL_FORMAT_RGB24:
+        return plane == 0 ? image.width * 3 : 0;
+    case POSTERIZE_PIXEL_FORMAT_I420:
+    case POSTERIZE_PIXEL_FORMAT_I422:
+        return plane == 0 ? image.width : halfWidth;
+    case POSTERIZE_PIXEL_FORMAT_I444:
+        return image.width;
+    case POSTERIZE_PIXEL_FORMAT_NV12:
+        return plane == 0 ? image.width : (plane == 1 ? halfWidth * 2 : 0);
+    default:
+        return 0;
+    }
+}
+
+bool InputImage::isValid(const posterize_image &image)
+{
+    if (!isYCbCr(image.format) && image.format != POSTERIZE_PIXEL_FORMAT_RGBA && image.format != POSTERIZE_PIXEL_FORMAT_BGRA && image.format != POSTERIZE_PIXEL_FORMAT_RGB24)
+    {
+        return false;
+    }
+    if (isYCbCr(image.format) && image.ycbcrRange != POSTERIZE_YCBCR_RANGE_FULL && image.ycbcrRange != POSTERIZE_YCBCR_RANGE_VIDEO)
+    {
+        return false;
+    }
+    if (image.width == 0 || image.height == 0)
+    {
+        return true;
+    }
+    if (image.width > SIZE_MAX / 4 / image.height)
+    {
+        return false;
+    }
+    for (size_t plane = 0; plane < 3; plane++)
+    {
+        size_t rowBytes = planeRowBytes(image, plane);
+        if (rowBytes != 0 && (!image.planes[plane] || image.strides[plane] < rowBytes))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+InputImage InputImage::fromRGBA(const uint8_t *rgba, size_t numPixels)
+{
+    posterize_image image = {};
+    image.format = POSTERIZE_PIXEL_FORMAT_RGBA;
+    image.width = numPixels;
+    image.height = 1;
+    image.planes[0] = rgba;
+    image.strides[0] = numPixels * 4;
+    return InputImage(image);
+}
+
+InputImage::InputImage(const posterize_image &image)
+    : InputImage(image, image.width, image.height)
+{
+}
+
+InputImage::InputImage(const posterize_image &image, size_t width, size_t height)
+    : m_image(image),
+      m_isPackedRGBA(image.format == POSTERIZE_PIXEL_FORMAT_RGBA && (image.height <= 1 || image.strides[0] == image.width * 4)),
+      m_width(width),
+      m_height(height)
+{
+}
+
+template <typename Layout>
+void InputImage::convertRows(uint8_t *rgba, size_t first, size_t count) const
+{
+    size_t y = first / m_image.width;
+    size_t x = first % m_image.width;
+    while (count > 0)
+    {
+        size_t rowPixels = std::min(count, m_image.width - x);
+        Layout::convertRow(rgba, m_image, y, x, rowPixels);
+        rgba += rowPixels * 4;
+        count -= rowPixels;
+        x = 0;
+        y++;
+    }
+}
+
+template <typename Range>
+void InputImage::convertYCbCr(uint8_t *rgba, size_t first, size_t count) const
+{
+    switch (m_image.format)
+    {
+    default:
+    case POSTERIZE_PIXEL_FORMAT_I420:
+        convertRows<LayoutPlanarYCbCr<1, 1, Range>>(rgba, first, count);
+        break;
+    case POSTERIZE_PIXEL_FORMAT_I422:
+        convertRows<LayoutPlanarYCbCr<1, 0, Range>>(rgba, first, count);
+        break;
+    case POSTERIZE_PIXEL_FORMAT_I444:
+        convertRows<LayoutPlanarYCbCr<0, 0, Range>>(rgba, first, count);
+        break;
+    case POSTERIZE_PIXEL_FORMAT_NV12:
+        convertRows<LayoutNV12<Range>>(rgba, first, count);
+        break;
+    }
+}
+
+void InputImage::convertSource(uint8_t *rgba, size_t first, size_t count) const
+{
+    if (m_image.format == POSTERIZE_PIXEL_FORMAT_RGBA)
+    {
+        convertRows<LayoutRGBA>(rgba, first, count);
+    }
+    else if (m_image.format == POSTERIZE_PIXEL_FORMAT_BGRA)
+    {
+        convertRows<LayoutBGRA>(rgba, first, count);
+    }
+    else if (m_image.format == POSTERIZE_PIXEL_FORMAT_RGB24)
+    {
+        convertRows<LayoutRGB24>(rgba, first, count);
+    }
+    else if (m_image.ycbcrRange == POSTERIZE_YCBCR_RANGE_VIDEO)
+    {
+        convertYCbCr<VideoRangeYCbCr>(rgba, first, count);
+    }
+    else
+    {
+        convertYCbCr<FullRangeYCbCr>(rgba, first, count);
+    }
+}
+
+// First source row or column of box i when scaling sourceSize rows or columns down to scaledSize
+static inline size_t boxStart(size_t i, size_t sourceSize, size_t scaledSize)
+{
+    return i * sourceSize / scaledSize;
+}
+
+// Output columns are processed in tiles so that their sums stay in L1 cache while the tile's source
+// rows stream through a small conversion buffer, a piece at a time. Every source pixel is read once.
+void InputImage::downscaleRow(uint8_t *rgba, size_t y, size_t x, size_t count) const
+{
+    constexpr size_t maxTileColumns = 128;
+    constexpr size_t maxPiecePixels = 256;
+    size_t firstRow = boxStart(y, m_image.height, m_height);
+    size_t endRow = boxStart(y + 1, m_image.height, m_height);
+    for (size_t tileStart = x; tileStart < x + count; tileStart += maxTileColumns)
+    {
+        size_t tileColumns = std::min(maxTileColumns, x + count - tileStart);
+        size_t firstColumn = boxStart(tileStart, m_image.width, m_width);
+        size_t columnEnds[maxTileColumns];
+        for (size_t j = 0; j < tileColumns; j++)
+        {
+            columnEnds[j] = boxStart(tileStart + j + 1, m_image.width, m_width);
+        }
+        size_t endColumn = boxStart(tileStart + tileColumns, m_image.width, m_width);
+
+        // Only the tile's columns are cleared: single pixels are downscaled one at a time when sampling
+        uint64_t sums[maxTileColumns][3];
+        std::fill(&sums[0][0], &sums[tileColumns][0], 0);
+        for (size_t sourceY = firstRow; sourceY < endRow; sourceY++)
+        {
+            size_t j = 0;
+            for (size_t pieceStart = firstColumn; pieceStart < endColumn; pieceStart += maxPiecePixels)
+            {
+                size_t piecePixels = std::min(maxPiecePixels, endColumn - pieceStart);
+                uint8_t piece[maxPiecePixels * 4];
+                convertSource(piece, sourceY * m_image.width + pieceStart, piecePixels);
+                for (size_t i = 0; i < piecePixels; i++)
+                {
+                    while (pieceStart + i >= columnEnds[j])
+                    {
+                        j++;
+                    }
+                    sums[j][0] += piece[i * 4 + 0];
+                    sums[j][1] += piece[i * 4 + 1];
+                    sums[j][2] += piece[i * 4 + 2];
+                }
+            }
+        }
+
+        size_t boxStartColumn = firstColumn;
+        for (size_t j = 0; j < tileColumns; j++)
+        {
+            uint64_t n = uint64_t(columnEnds[j] - boxStartColumn) * (endRow - firstRow);
+            uint8_t *pixel = &rgba[(tileStart - x + j) * 4];
+            pixel[0] = uint8_t((sums[j][0] + n / 2) / n);
+            pixel[1] = uint8_t((sums[j][1] + n / 2) / n);
+            pixel[2] = uint8_t((sums[j][2] + n / 2) / n);
+            pixel[3] = 0xff;
+            boxStartColumn = columnEnds[j];
+        }
+    }
+}
+
+void InputImage::convert(uint8_t *rgba, size_t first, size_t count) const
+{
+    if (!isScaled())
+    {
+        convertSource(rgba, first, count);
+        return;
+    }
+
+    size_t y = first / m_width;
+    size_t x = first % m_width;
+    while (count > 0)
+    {
+        size_t rowPixels = std::min(count, m_width - x);
+        downscaleRow(rgba, y, x, rowPixels);
+        rgba += rowPixels * 4;
+        count -= rowPixels;
+        x = 0;
+        y++;
+    }
+}
+
+void InputImage::convertParallel(uint8_t *rgba, size_t first, size_t count, const Workers &workers) const
+{
+    PixelChunks chunks(count, workers.numThreads);
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        convert(&rgba[chunks.begin(chunk) * 4], first + chunks.begin(chunk), chunks.size(chunk));
+    });
+}
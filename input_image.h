@@ -0,0 +1,84 @@
+/*
+ * input_image.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Input images in any of the layouts described by posterize_image, optionally downscaled. The
+ * engines all read interleaved RGBA, so images in other layouts, or downscaled, are converted to it
+ * a run of pixels at a time.
+ */
+
+#ifndef INPUT_IMAGE_H
+#define INPUT_IMAGE_H
+
+#include "posterize.h"
+#include "kmeans.h"
+#include <cstddef>
+#include <cstdint>
+
+class InputImage
+{
+public:
+    // Whether a descriptor is complete and consistent: known format and range, the planes the
+    // format needs, and strides that hold a row
+    static bool isValid(const posterize_image &image);
+
+    // Tightly packed RGBA pixels, treated as a single row
+    static InputImage fromRGBA(const uint8_t *rgba, size_t numPixels);
+
+    // The descriptor must be valid
+    explicit InputImage(const posterize_image &image);
+
+    // Whether an image can be downscaled to width x height: neither dimension may grow. Either may
+    // shrink to 0, which leaves no pixels to convert.
+    static bool isValidScale(const posterize_image &image, size_t width, size_t height)
+    {
+        return width <= image.width && height <= image.height;
+    }
+
+    // The image downscaled to width x height with a box filter: each pixel is the rounded mean of
+    // the source pixels in its box, and boxes tile the source image. Source pixels are converted and
+    // averaged whenever pixels are converted, so the full-size image is never converted at once.
+    InputImage(const posterize_image &image, size_t width, size_t height);
+
+    size_t numPixels() const
+    {
+        return m_width * m_height;
+    }
+
+    // The pixels, if they are tightly packed RGBA that can be read in place, otherwise null
+    const uint8_t *rgba() const
+    {
+        return m_isPackedRGBA && !isScaled() ? m_image.planes[0] : nullptr;
+    }
+
+    // Writes count pixels, starting with pixel first in row-major order, to rgba as RGBA. Alpha is
+    // copied from RGBA and BGRA images and set to 0xff otherwise.
+    void convert(uint8_t *rgba, size_t first, size_t count) const;
+
+    // Same as convert(), split among workers
+    void convertParallel(uint8_t *rgba, size_t first, size_t count, const Workers &workers) const;
+
+private:
+    bool isScaled() const
+    {
+        return m_width != m_image.width || m_height != m_image.height;
+    }
+
+    // Same as convert() but for source pixels
+    void convertSource(uint8_t *rgba, size_t first, size_t count) const;
+
+    void downscaleRow(uint8_t *rgba, size_t y, size_t x, size_t count) const;
+
+    template <typename Layout>
+    void convertRows(uint8_t *rgba, size_t first, size_t count) const;
+
+    template <typename Range>
+    void convertYCbCr(uint8_t *rgba, size_t first, size_t count) const;
+
+    posterize_image m_image;
+    bool m_isPackedRGBA;
+    size_t m_width;     // after scaling
+    size_t m_height;
+};
+
+#endif // INPUT_IMAGE_H
@@ -0,0 +1,339 @@
+/*
+ * kmeans.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * k-means clustering of RGB colors into 2, 4, 16, or 256 clusters.
+ */
+
+#include "kmeans.h"
+#include "candidate_grid.h"
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+// Working set of the assignment pass: points are assigned and summed in blocks of this size, which is
+// a multiple of 16 so that SIMD kernels stay on their fast path
+constexpr size_t kBlockSize = 1024;
+
+// Adds each point's RGB value, times its weight, to the sums of the cluster it is labeled with
+template <bool Weighted>
+static void accumulateClusterSums(ClusterSums *sums, const uint8_t *labels, const uint8_t *rgba, const uint32_t *weights, size_t numPoints)
+{
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        size_t k = labels[i];
+        uint64_t weight = Weighted ? weights[i] : 1;
+        sums->color[k].r += rgba[i * 4 + 0] * weight;
+        sums->color[k].g += rgba[i * 4 + 1] * weight;
+        sums->color[k].b += rgba[i * 4 + 2] * weight;
+        sums->count[k] += weight;
+    }
+}
+
+void computeCentroids(Centroid centroids[], size_t numCentroids, const Color sums[], const size_t counts[])
+{
+    for (size_t i = 0; i < numCentroids; i++)
+    {
+        Color mean;
+        if (counts[i] != 0)
+        {
+            mean.r = sums[i].r / counts[i];
+            mean.g = sums[i].g / counts[i];
+            mean.b = sums[i].b / counts[i];
+        }
+        centroids[i] = { .r = uint8_t(mean.r), .g = uint8_t(mean.g), .b = uint8_t(mean.b) };
+    }
+}
+
+// Assigns a block of points starting at the first label of a byte with assign(byteLabels, rgba,
+// numPoints), which has the semantics of an AssignPixelsFn. Packed labels are assigned into scratch
+// and then packed. Returns the block's byte labels.
+template <typename AssignFn>
+static const uint8_t *assignBlock(bool *didChange, uint8_t scratch[kBlockSize], Labels labels, const uint8_t *rgba, size_t blockStart, size_t blockPoints, AssignFn &assign)
+{
+    if (labels.isPacked())
+    {
+        assign(scratch, &rgba[blockStart * 4], blockPoints);
+        *didChange |= packIndices(labels.byteAt(blockStart), scratch, blockPoints, labels.bitsPerLabel);
+        return scratch;
+    }
+    *didChange |= assign(&labels.data[blockStart], &rgba[blockStart * 4], blockPoints);
+    return &labels.data[blockStart];
+}
+
+// Per-chunk assignment function: the SIMD kernel, a candidate grid if one is given, or an assignment
+// cache on top of the kernel if cacheStats is not null, in which case the cache's statistics are
+// added to it when done
+class ChunkAssigner
+{
+public:
+    ChunkAssigner(const Centroid centroids[], size_t numCentroids, posterize_metric metric, const CandidateGrid *grid, AssignmentCacheStats *cacheStats)
+        : m_centroids(centroids),
+          m_assignPixels(getAssignPixelsKernel(metric, numCentroids)),
+          m_grid(grid),
+          m_cacheStats(cacheStats)
+    {
+        if (cacheStats)
+        {
+            m_cache.emplace(centroids, numCentroids, metric);
+        }
+    }
+
+    ~ChunkAssigner()
+    {
+        if (m_cache)
+        {
+            m_cacheStats->add(m_cache->stats());
+        }
+    }
+
+    bool operator()(uint8_t *labels, const uint8_t *rgba, size_t numPoints)
+    {
+        if (m_cache)
+        {
+            return m_cache->assignPixels(labels, rgba, numPoints);
+        }
+        return m_grid ? m_grid->assignPixels(labels, rgba, numPoints) : m_assignPixels(labels, rgba, numPoints, m_centroids);
+    }
+
+private:
+    const Centroid *m_centroids;
+    AssignPixelsFn m_assignPixels;
+    const CandidateGrid *m_grid;
+    AssignmentCacheStats *m_cacheStats;
+    std::optional<AssignmentCache> m_cache;
+};
+
+// Sums per-chunk cache statistics into stats, if requested
+static void addCacheStats(AssignmentCacheStats *stats, const std::vector<AssignmentCacheStats> &chunkStats)
+{
+    if (stats)
+    {
+        for (const AssignmentCacheStats &chunk : chunkStats)
+        {
+            stats->add(chunk);
+        }
+    }
+}
+
+// Reduces per-chunk sums and computes centroids from them
+static void computeCentroidsFromChunkSums(Centroid centroids[], size_t numCentroids, const std::vector<ClusterSums> &chunkSums)
+{
+    Color totals[kMaxCentroids];
+    size_t numPixelsInCluster[kMaxCentroids] = {};
+    for (size_t i = 0; i < numCentroids; i++)
+    {
+        for (const ClusterSums &chunk : chunkSums)
+        {
+            totals[i].r += chunk.color[i].r;
+            totals[i].g += chunk.color[i].g;
+            totals[i].b += chunk.color[i].b;
+            numPixelsInCluster[i] += chunk.count[i];
+        }
+    }
+    computeCentroids(centroids, numCentroids, totals, numPixelsInCluster);
+}
+
+// Number of points, each counting weights[i] times or once if weights is null, whose labels differ
+// between two label blocks
+static size_t countChangedLabels(const uint8_t *before, const uint8_t *after, const uint32_t *weights, size_t numPoints)
+{
+    size_t numChanged = 0;
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        numChanged += before[i] != after[i] ? (weights ? weights[i] : 1) : 0;
+    }
+    return numChanged;
+}
+
+// Assigns points [begin, end) and adds them to sums, a block at a time. Blocks are summed while they
+// are still in L1 cache, so that the points are streamed through memory only once. If numChanged is
+// not null, the number of labels that changed, weighted like the points, is added to it. Returns true
+// if any label changed.
+static bool assignAndSumPoints(ClusterSums *sums, size_t *numChanged, Labels labels, const uint8_t *rgba, const uint32_t *weights, size_t begin, size_t end, ChunkAssigner &assign)
+{
+    uint8_t scratch[kBlockSize];
+    uint8_t previousLabels[kBlockSize];
+    bool didChange = false;
+    for (size_t blockStart = begin; blockStart < end; blockStart += kBlockSize)
+    {
+        size_t blockPoints = std::min(kBlockSize, end - blockStart);
+        if (numChanged)
+        {
+            unpackIndices(previousLabels, labels.byteAt(blockStart), blockPoints, labels.bitsPerLabel);
+        }
+        const uint8_t *blockLabels = assignBlock(&didChange, scratch, labels, rgba, blockStart, blockPoints, assign);
+        if (numChanged)
+        {
+            *numChanged += countChangedLabels(previousLabels, blockLabels, weights ? &weights[blockStart] : nullptr, blockPoints);
+        }
+        if (weights)
+        {
+            accumulateClusterSums<true>(sums, blockLabels, &rgba[blockStart * 4], &weights[blockStart], blockPoints);
+        }
+        else
+        {
+            accumulateClusterSums<false>(sums, blockLabels, &rgba[blockStart * 4], nullptr, blockPoints);
+        }
+    }
+    return didChange;
+}
+
+KMeansResult runKMeans(Centroid centroids[], size_t numCentroids, Labels labels, const uint8_t *rgba, const uint32_t *weights, size_t numPoints, const KMeansLimits &limits, const Workers &workers, posterize_metric metric, AssignmentCacheStats *cacheStats)
+{
+    PixelChunks chunks(numPoints, workers.numThreads);
+    std::vector<ClusterSums> chunkSums(chunks.count());
+    std::unique_ptr<bool[]> chunkDidChange = std::make_unique<bool[]>(chunks.count());
+    std::vector<size_t> chunkNumChanged(chunks.count());
+    std::vector<AssignmentCacheStats> chunkCacheStats(cacheStats ? chunks.count() : 0);
+
+    // Large palettes are searched through a candidate grid, rebuilt for each iteration's centroids
+    std::unique_ptr<CandidateGrid> grid;
+    if (!cacheStats && CandidateGrid::isWorthwhile(numCentroids, numPoints))
+    {
+        grid = std::make_unique<CandidateGrid>(rgba, numPoints, workers);
+    }
+
+    // Changed labels are counted in pixels, which weighted points stand for several of
+    size_t numPixels = weights && limits.countsChanges() ? std::accumulate(weights, weights + numPoints, size_t(0)) : numPoints;
+
+    // Repeat k-means until complete
+    KMeansResult result = { .iterations = 0, .stopReason = POSTERIZE_STOP_CONVERGED };
+    while (true)
+    {
+        std::chrono::steady_clock::time_point iterationStart = std::chrono::steady_clock::now();
+        const CandidateGrid *activeGrid = nullptr;
+        if (grid)
+        {
+            grid->build(centroids, numCentroids, metric, workers);
+            activeGrid = grid->isSelective() ? grid.get() : nullptr;
+        }
+
+        // Assign each point to nearest cluster (cluster whose centroid is nearest) and, in the same
+        // pass, sum up the new clusters
+        workers.parallelFor(chunks.count(), [&](size_t chunk)
+        {
+            ChunkAssigner assign(centroids, numCentroids, metric, activeGrid, cacheStats ? &chunkCacheStats[chunk] : nullptr);
+            chunkSums[chunk] = ClusterSums();
+            chunkNumChanged[chunk] = 0;
+            size_t *numChanged = limits.countsChanges() && result.iterations > 0 ? &chunkNumChanged[chunk] : nullptr;
+            chunkDidChange[chunk] = assignAndSumPoints(&chunkSums[chunk], numChanged, labels, rgba, weights, chunks.begin(chunk), chunks.begin(chunk) + chunks.size(chunk), assign);
+        });
+        bool didChange = std::any_of(&chunkDidChange[0], &chunkDidChange[chunks.count()], [](bool changed) { return changed; });
+        size_t numChanged = std::accumulate(chunkNumChanged.begin(), chunkNumChanged.end(), size_t(0));
+        addCacheStats(cacheStats, chunkCacheStats);
+        std::fill(chunkCacheStats.begin(), chunkCacheStats.end(), AssignmentCacheStats());
+        result.iterations++;
+        if (limits.shouldStop(&result.stopReason, result.iterations, didChange, numChanged, numPixels, iterationStart))
+        {
+            break;
+        }
+
+        // Compute average for each cluster. Centroids that barely move are kept, since the labels
+        // were assigned against them.
+        Centroid next[kMaxCentroids];
+        computeCentroidsFromChunkSums(next, numCentroids, chunkSums);
+        if (limits.hasSettled(centroids, next, numCentroids))
+        {
+            result.stopReason = POSTERIZE_STOP_TOLERANCE;
+            break;
+        }
+        std::copy(next, next + numCentroids, centroids);
+    }
+    return result;
+}
+
+bool assignAndSumParallel(ClusterSums *sums, size_t *numChanged, Labels labels, const uint8_t *rgba, size_t numPoints, const Centroid centroids[], size_t numCentroids, const CandidateGrid *grid, const Workers &workers, posterize_metric metric)
+{
+    PixelChunks chunks(numPoints, workers.numThreads);
+    std::vector<ClusterSums> chunkSums(chunks.count());
+    std::unique_ptr<bool[]> chunkDidChange = std::make_unique<bool[]>(chunks.count());
+    std::vector<size_t> chunkNumChanged(chunks.count());
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        ChunkAssigner assign(centroids, numCentroids, metric, grid, nullptr);
+        chunkDidChange[chunk] = assignAndSumPoints(&chunkSums[chunk], numChanged ? &chunkNumChanged[chunk] : nullptr, labels, rgba, nullptr, chunks.begin(chunk), chunks.begin(chunk) + chunks.size(chunk), assign);
+    });
+    for (const ClusterSums &chunk : chunkSums)
+    {
+        for (size_t i = 0; i < numCentroids; i++)
+        {
+            sums->color[i].r += chunk.color[i].r;
+            sums->color[i].g += chunk.color[i].g;
+            sums->color[i].b += chunk.color[i].b;
+            sums->count[i] += chunk.count[i];
+        }
+    }
+    if (numChanged)
+    {
+        *numChanged += std::accumulate(chunkNumChanged.begin(), chunkNumChanged.end(), size_t(0));
+    }
+    return std::any_of(&chunkDidChange[0], &chunkDidChange[chunks.count()], [](bool changed) { return changed; });
+}
+
+bool assignPixelsParallel(Labels labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[], size_t numCentroids, const Workers &workers, posterize_metric metric, AssignmentCacheStats *cacheStats)
+{
+    PixelChunks chunks(numPixels, workers.numThreads);
+    std::unique_ptr<bool[]> chunkDidChange = std::make_unique<bool[]>(chunks.count());
+    std::vector<AssignmentCacheStats> chunkCacheStats(cacheStats ? chunks.count() : 0);
+    std::unique_ptr<CandidateGrid> grid;
+    if (!cacheStats && CandidateGrid::isWorthwhile(numCentroids, numPixels))
+    {
+        grid = std::make_unique<CandidateGrid>(rgba, numPixels, workers);
+        grid->build(centroids, numCentroids, metric, workers);
+        if (!grid->isSelective())
+        {
+            grid.reset();
+        }
+    }
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        uint8_t scratch[kBlockSize];
+        ChunkAssigner assign(centroids, numCentroids, metric, grid.get(), cacheStats ? &chunkCacheStats[chunk] : nullptr);
+        bool didChange = false;
+        size_t chunkEnd = chunks.begin(chunk) + chunks.size(chunk);
+        for (size_t blockStart = chunks.begin(chunk); blockStart < chunkEnd; blockStart += kBlockSize)
+        {
+            assignBlock(&didChange, scratch, labels, rgba, blockStart, std::min(kBlockSize, chunkEnd - blockStart), assign);
+        }
+        chunkDidChange[chunk] = didChange;
+    });
+    addCacheStats(cacheStats, chunkCacheStats);
+    return std::any_of(&chunkDidChange[0], &chunkDidChange[chunks.count()], [](bool changed) { return changed; });
+}
+
+double measureMeanSquaredError(Labels labels, const uint8_t *rgba, const uint32_t *weights, size_t numPoints, const Centroid centroids[], const Workers &workers)
+{
+    PixelChunks chunks(numPoints, workers.numThreads);
+    std::vector<uint64_t> chunkError(chunks.count());
+    std::vector<uint64_t> chunkWeight(chunks.count());
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        uint8_t blockLabels[kBlockSize];
+        uint64_t error = 0;
+        uint64_t totalWeight = 0;
+        size_t chunkEnd = chunks.begin(chunk) + chunks.size(chunk);
+        for (size_t blockStart = chunks.begin(chunk); blockStart < chunkEnd; blockStart += kBlockSize)
+        {
+            size_t blockPoints = std::min(kBlockSize, chunkEnd - blockStart);
+            unpackIndices(blockLabels, labels.byteAt(blockStart), blockPoints, labels.bitsPerLabel);
+            for (size_t i = 0; i < blockPoints; i++)
+            {
+                const uint8_t *point = &rgba[(blockStart + i) * 4];
+                const Centroid &centroid = centroids[blockLabels[i]];
+                int dr = int(point[0]) - centroid.r;
+                int dg = int(point[1]) - centroid.g;
+                int db = int(point[2]) - centroid.b;
+                uint64_t weight = weights ? weights[blockStart + i] : 1;
+                error += uint64_t(dr * dr + dg * dg + db * db) * weight;
+                totalWeight += weight;
+            }
+        }
+        chunkError[chunk] = error;
+        chunkWeight[chunk] = totalWeight;
+    });
+    uint64_t totalWeight = std::accumulate(chunkWeight.begin(), chunkWeight.end(), uint64_t(0));
+    uint64_t error = std::accumulate(chunkError.begin(), chunkError.end(), uint64_t(0));
+    return totalWeight == 0 ? 0.0 : double(error) / double(totalWeight);
+}
@@ -0,0 +1,236 @@
+/*
+ * kmeans.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * k-means clustering of RGB colors into 2, 4, 16, or 256 clusters. Points (pixels or weighted
+ * colors) are stored as RGBA, with alpha ignored, and read in place. Cluster labels are kept in a
+ * separate buffer.
+ */
+
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include "assignment_cache.h"
+#include "nearest_centroid.h"
+#include "pixel_packing.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+class CandidateGrid;
+
+// Sum of RGB values (or, after division, mean RGB value) of a color cluster
+struct Color
+{
+    uint64_t r = 0;
+    uint64_t g = 0;
+    uint64_t b = 0;
+};
+
+// Per-chunk cluster accumulators. Aligned so that chunks processed by different threads do not
+// share cache lines.
+struct alignas(64) ClusterSums
+{
+    Color color[kMaxCentroids];
+    size_t count[kMaxCentroids] = {};
+};
+
+// Splits a pixel buffer into contiguous chunks that can be processed in parallel. There are a few
+// more chunks than threads to balance the load, but never chunks so small that scheduling overhead
+// dominates. Chunk boundaries fall on multiples of 16 pixels so that SIMD kernels do not have to
+// fall back to scalar code except at the very end of the buffer.
+class PixelChunks
+{
+public:
+    PixelChunks(size_t numPixels, size_t numThreads)
+        : m_numPixels(numPixels)
+    {
+        constexpr size_t minChunkSize = 32768;
+        constexpr size_t chunksPerThread = 4;
+        size_t numChunks = std::min(numThreads * chunksPerThread, (numPixels + minChunkSize - 1) / minChunkSize);
+        numChunks = std::max(numChunks, size_t(1));
+        m_chunkSize = ((numPixels + numChunks - 1) / numChunks + 15) & ~size_t(15);
+        m_numChunks = m_chunkSize == 0 ? 1 : (numPixels + m_chunkSize - 1) / m_chunkSize;
+    }
+
+    size_t count() const
+    {
+        return m_numChunks;
+    }
+
+    size_t begin(size_t chunk) const
+    {
+        return chunk * m_chunkSize;
+    }
+
+    size_t size(size_t chunk) const
+    {
+        return std::min(m_chunkSize, m_numPixels - begin(chunk));
+    }
+
+private:
+    size_t m_numPixels;
+    size_t m_chunkSize;
+    size_t m_numChunks;
+};
+
+// Cluster label of each point, 1, 2, 4, or 8 bits each. Labels narrower than a byte are packed with
+// the first point in the most significant bits (see pixel_packing.h), exactly like posterize()'s
+// output image so that labels can be written straight into it. When packed, points processed by
+// different threads must not share a byte, which holds for PixelChunks.
+struct Labels
+{
+    uint8_t *data;
+    unsigned bitsPerLabel;
+
+    bool isPacked() const
+    {
+        return bitsPerLabel < 8;
+    }
+
+    // Byte holding label i, which must be the first label in its byte
+    uint8_t *byteAt(size_t i) const
+    {
+        return &data[i * bitsPerLabel / 8];
+    }
+
+    uint8_t get(size_t i) const
+    {
+        unsigned log2LabelsPerByte = 3 - unsigned(__builtin_ctz(bitsPerLabel));
+        unsigned shiftAmount = unsigned(~i & ((size_t(1) << log2LabelsPerByte) - 1)) * bitsPerLabel;
+        return uint8_t((data[i >> log2LabelsPerByte] >> shiftAmount) & ((1u << bitsPerLabel) - 1));
+    }
+
+    void set(size_t i, uint8_t k) const
+    {
+        unsigned log2LabelsPerByte = 3 - unsigned(__builtin_ctz(bitsPerLabel));
+        unsigned shiftAmount = unsigned(~i & ((size_t(1) << log2LabelsPerByte) - 1)) * bitsPerLabel;
+        unsigned mask = ((1u << bitsPerLabel) - 1) << shiftAmount;
+        uint8_t &byte = data[i >> log2LabelsPerByte];
+        byte = uint8_t((byte & ~mask) | (unsigned(k) << shiftAmount));
+    }
+};
+
+// Iteration limit used by posterize()
+constexpr size_t kMaxIterations = 24;
+
+// When k-means stops short of convergence (an iteration that changes no labels): after
+// maxIterations iterations, after an iteration that changes no more than maxChangedFraction of the
+// labels, when no centroid would move by more than maxCentroidShift, or when the next iteration
+// would not finish before the deadline, assuming that it takes as long as the last one. Tolerances
+// of 0 are never met. The first iteration always runs, so that every point is labeled.
+struct KMeansLimits
+{
+    size_t maxIterations = kMaxIterations;
+    double maxChangedFraction = 0;
+    double maxCentroidShift = 0;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    // Whether labels that changed have to be counted
+    bool countsChanges() const
+    {
+        return maxChangedFraction > 0;
+    }
+
+    // Whether to stop after an iteration that began at iterationStart and changed numChanged of the
+    // numPoints labels (if counted) or, per didChange, at least one. Sets reason if so.
+    bool shouldStop(posterize_stop_reason *reason, size_t iterations, bool didChange, size_t numChanged, size_t numPoints, std::chrono::steady_clock::time_point iterationStart) const
+    {
+        if (!didChange && iterations > 1)
+        {
+            *reason = POSTERIZE_STOP_CONVERGED;
+        }
+        else if (iterations >= maxIterations)
+        {
+            *reason = POSTERIZE_STOP_ITERATION_LIMIT;
+        }
+        else if (countsChanges() && iterations > 1 && double(numChanged) <= maxChangedFraction * double(numPoints))
+        {
+            *reason = POSTERIZE_STOP_TOLERANCE;
+        }
+        else
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now + (now - iterationStart) <= deadline)
+            {
+                return false;
+            }
+            *reason = POSTERIZE_STOP_TIME_BUDGET;
+        }
+        return true;
+    }
+
+    // Whether no centroid moves by more than maxCentroidShift in RGB from current to next
+    bool hasSettled(const Centroid current[], const Centroid next[], size_t numCentroids) const
+    {
+        if (maxCentroidShift <= 0)
+        {
+            return false;
+        }
+        for (size_t k = 0; k < numCentroids; k++)
+        {
+            int dr = int(next[k].r) - current[k].r;
+            int dg = int(next[k].g) - current[k].g;
+            int db = int(next[k].b) - current[k].b;
+            if (double(dr * dr + dg * dg + db * db) > maxCentroidShift * maxCentroidShift)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// How a k-means run ended
+struct KMeansResult
+{
+    size_t iterations;
+    posterize_stop_reason stopReason;
+};
+
+// Threads that an engine may use: a pool and the maximum number of its threads to occupy
+struct Workers
+{
+    ThreadPool &pool;
+    size_t numThreads;
+
+    void parallelFor(size_t numTasks, const std::function<void(size_t task)> &fn) const
+    {
+        pool.parallelFor(numTasks, fn, numThreads);
+    }
+};
+
+// Divides cluster sums by cluster sizes to obtain centroids. Empty clusters get a black centroid.
+extern void computeCentroids(Centroid centroids[], size_t numCentroids, const Color sums[], const size_t counts[]);
+
+// Runs k-means starting from the numCentroids initial centroids passed in, which must be a
+// supported cluster count (see isSupportedClusterCount()). Each iteration assigns the points to
+// their nearest centroids by the given metric and, unless that changed no labels (the first
+// iteration always counts as a change) or one of the limits is reached, recomputes the centroids.
+// Clusters are summed during the assignment pass, so each iteration reads the points only once.
+// Each point stands for weights[i] pixels, or for one pixel if weights is null. On return, labels
+// holds the final labels and centroids holds the cluster means against which they were assigned.
+// If cacheStats is not null, assignment goes through an AssignmentCache whose statistics are added
+// to it. Otherwise, large palettes are searched through a CandidateGrid when that pays off.
+// Returns the number of iterations performed and why they stopped.
+extern KMeansResult runKMeans(Centroid centroids[], size_t numCentroids, Labels labels, const uint8_t *rgba, const uint32_t *weights, size_t numPoints, const KMeansLimits &limits, const Workers &workers, posterize_metric metric, AssignmentCacheStats *cacheStats = nullptr);
+
+// One iteration's assignment pass over some of the points, for points that arrive a piece at a
+// time: assigns each point to its nearest centroid by the given metric, through grid if not null,
+// and adds it to sums. If numChanged is not null, the number of labels that changed is added to
+// it. Returns true if any label changed.
+extern bool assignAndSumParallel(ClusterSums *sums, size_t *numChanged, Labels labels, const uint8_t *rgba, size_t numPoints, const Centroid centroids[], size_t numCentroids, const CandidateGrid *grid, const Workers &workers, posterize_metric metric);
+
+// Assigns each pixel to its nearest centroid by the given metric in parallel, through an
+// AssignmentCache if cacheStats is not null and otherwise, for large palettes, through a
+// CandidateGrid. Returns true if any label changed.
+extern bool assignPixelsParallel(Labels labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[], size_t numCentroids, const Workers &workers, posterize_metric metric, AssignmentCacheStats *cacheStats = nullptr);
+
+// Mean squared RGB distance from each point to the centroid it is labeled with, each point counting
+// weights[i] times, or once if weights is null
+extern double measureMeanSquaredError(Labels labels, const uint8_t *rgba, const uint32_t *weights, size_t numPoints, const Centroid centroids[], const Workers &workers);
+
+#endif // KMEANS_H
@@ -0,0 +1,122 @@
+/*
+ * kmeans_core.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Compile-time specialized core of nearest-centroid assignment, parameterized on the number of
+ * clusters and the distance metric. The loop over clusters is fully
+ * unrolled, so each specialization compiles to straight-line code with its constants folded in.
+ * Only specializations that are actually used are instantiated.
+ */
+
+#ifndef KMEANS_CORE_H
+#define KMEANS_CORE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POSTERIZE_X86 1
+#endif
+
+// Cluster count of the default 4-bit output, and the largest supported cluster count (8-bit output)
+constexpr size_t kNumCentroids = 16;
+constexpr size_t kMaxCentroids = 256;
+
+// Cluster centroid as an 8-bit RGB color
+struct Centroid
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+/*
+ * Distance metrics: squared differences of the R, G, and B channels, each multiplied by an integer
+ * weight. Weights must be at most 8 so that weighted squared distances fit the keys below, and
+ * differences times weights fit the 16-bit lanes of the SIMD kernels.
+ */
+
+// Plain squared Euclidean distance in RGB
+struct SquaredEuclidean
+{
+    static constexpr uint32_t kWeightR = 1;
+    static constexpr uint32_t kWeightG = 1;
+    static constexpr uint32_t kWeightB = 1;
+};
+
+// Squared differences weighted roughly by each channel's contribution to ITU BT.601 luminance
+// (0.299, 0.587, 0.114), so that errors in green count the most and errors in blue the least
+struct LumaWeightedSquaredEuclidean
+{
+    static constexpr uint32_t kWeightR = 3;
+    static constexpr uint32_t kWeightG = 6;
+    static constexpr uint32_t kWeightB = 1;
+};
+
+template <typename Metric>
+constexpr bool isUnweighted()
+{
+    return Metric::kWeightR == 1 && Metric::kWeightG == 1 && Metric::kWeightB == 1;
+}
+
+template <typename Metric>
+inline uint32_t colorDistance(const Centroid &centroid, uint8_t r, uint8_t g, uint8_t b)
+{
+    static_assert(Metric::kWeightR <= 8 && Metric::kWeightG <= 8 && Metric::kWeightB <= 8, "Metric weights too large");
+    int32_t dr = int32_t(centroid.r) - r;
+    int32_t dg = int32_t(centroid.g) - g;
+    int32_t db = int32_t(centroid.b) - b;
+    return Metric::kWeightR * uint32_t(dr * dr) + Metric::kWeightG * uint32_t(dg * dg) + Metric::kWeightB * uint32_t(db * db);
+}
+
+// Number of bits needed to hold a cluster index
+template <size_t K>
+constexpr unsigned indexBits()
+{
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < K)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+template <size_t K, typename Metric, size_t... Ks>
+inline uint32_t nearestCentroidUnrolled(uint8_t r, uint8_t g, uint8_t b, const Centroid centroids[], std::index_sequence<Ks...>)
+{
+    // Keys combine the distance with the index, (distance << indexBits) | k, so that a branchless
+    // unsigned minimum yields the nearest centroid with ties going to the lowest index
+    constexpr unsigned shiftAmount = indexBits<K>();
+    uint32_t best = UINT32_MAX;
+    ((best = std::min(best, (colorDistance<Metric>(centroids[Ks], r, g, b) << shiftAmount) | uint32_t(Ks))), ...);
+    return best & ((uint32_t(1) << shiftAmount) - 1);
+}
+
+// Index of the centroid nearest to a color, ties going to the lowest index
+template <size_t K, typename Metric>
+inline uint32_t nearestCentroid(uint8_t r, uint8_t g, uint8_t b, const Centroid centroids[])
+{
+    static_assert(K >= 2 && K <= 256, "Cluster count must be in [2, 256]");
+    static_assert((uint64_t(255 * 255) * (Metric::kWeightR + Metric::kWeightG + Metric::kWeightB) << indexBits<K>()) <= UINT32_MAX, "Keys do not fit in 32 bits");
+    return nearestCentroidUnrolled<K, Metric>(r, g, b, centroids, std::make_index_sequence<K>());
+}
+
+// Assigns each RGBA pixel (alpha is ignored) to the nearest of K centroids and writes the index to
+// labels, one byte per pixel. Returns true if any pixel's label changed.
+template <size_t K, typename Metric>
+bool assignPixels(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    bool didChange = false;
+    for (size_t i = 0; i < numPixels; i++)
+    {
+        const uint8_t *pixel = &rgba[i * 4];
+        uint8_t k = uint8_t(nearestCentroid<K, Metric>(pixel[0], pixel[1], pixel[2], centroids));
+        didChange |= labels[i] != k;
+        labels[i] = k;
+    }
+    return didChange;
+}
+
+#endif // KMEANS_CORE_H
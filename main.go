@@ -5,6 +5,7 @@ import (
 	// #include "posterize.h"
 	// #include <stdlib.h>
 	"C"
+	"flag"
 	"fmt"
 	"image/jpeg"
 	"os"
@@ -12,22 +13,24 @@ import (
 import (
 	"image"
 	"image/color"
+	"runtime"
+	"syscall"
+	"unsafe"
 )
 
-func decodeJPEGToLinearRGBA(filePath string) ([]uint8, int, int, error) {
+func decodeJPEG(filePath string) (image.Image, error) {
 	// Open the JPEG file
 	file, err := os.Open(filePath)
 	if err != nil {
-		return nil, 0, 0, err
+		return nil, err
 	}
 	defer file.Close()
 
 	// Decode the JPEG image
-	img, err := jpeg.Decode(file)
-	if err != nil {
-		return nil, 0, 0, err
-	}
+	return jpeg.Decode(file)
+}
 
+func imageToLinearRGBA(img image.Image) []uint8 {
 	// Get the dimensions of the image
 	bounds := img.Bounds()
 	width, height := bounds.Dx(), bounds.Dy()
@@ -35,8 +38,8 @@ func decodeJPEGToLinearRGBA(filePath string) ([]uint8, int, int, error) {
 	// Flatten the RGBA values into a linear array
 	rgbaLinear := make([]uint8, width*height*4)
 	index := 0
-	for y := 0; y < height; y++ {
-		for x := 0; x < width; x++ {
+	for y := bounds.Min.Y; y < bounds.Max.Y; y++ {
+		for x := bounds.Min.X; x < bounds.Max.X; x++ {
 			r, g, b, a := img.At(x, y).RGBA()
 			rgbaLinear[index] = uint8(r >> 8)
 			rgbaLinear[index+1] = uint8(g >> 8)
@@ -46,7 +49,77 @@ func decodeJPEGToLinearRGBA(filePath string) ([]uint8, int, int, error) {
 		}
 	}
 
-	return rgbaLinear, width, height, nil
+	return rgbaLinear
+}
+
+// Describes an image for posterizeImageWithContext(). JPEGs usually decode to YCbCr, which is
+// passed as is and converted by the library, and RGBA images are passed as is; anything else is
+// flattened to RGBA first. The descriptor points into Go memory, which is pinned until the pinner
+// is unpinned.
+func describeImage(img image.Image, pinner *runtime.Pinner) C.posterize_image {
+	var input C.posterize_image
+	bounds := img.Bounds()
+	input.width = C.size_t(bounds.Dx())
+	input.height = C.size_t(bounds.Dy())
+
+	if ycbcr, ok := img.(*image.YCbCr); ok && !bounds.Empty() && bounds.Min.X%2 == 0 && bounds.Min.Y%2 == 0 {
+		formats := map[image.YCbCrSubsampleRatio]C.posterize_pixel_format{
+			image.YCbCrSubsampleRatio420: C.POSTERIZE_PIXEL_FORMAT_I420,
+			image.YCbCrSubsampleRatio422: C.POSTERIZE_PIXEL_FORMAT_I422,
+			image.YCbCrSubsampleRatio444: C.POSTERIZE_PIXEL_FORMAT_I444,
+		}
+		if format, ok := formats[ycbcr.SubsampleRatio]; ok {
+			planes := []*uint8{
+				&ycbcr.Y[ycbcr.YOffset(bounds.Min.X, bounds.Min.Y)],
+				&ycbcr.Cb[ycbcr.COffset(bounds.Min.X, bounds.Min.Y)],
+				&ycbcr.Cr[ycbcr.COffset(bounds.Min.X, bounds.Min.Y)],
+			}
+			for i, plane := range planes {
+				pinner.Pin(plane)
+				input.planes[i] = (*C.uint8_t)(unsafe.Pointer(plane))
+			}
+			input.format = format
+			input.strides[0] = C.size_t(ycbcr.YStride)
+			input.strides[1] = C.size_t(ycbcr.CStride)
+			input.strides[2] = C.size_t(ycbcr.CStride)
+			input.ycbcrRange = C.POSTERIZE_YCBCR_RANGE_FULL
+			return input
+		}
+	}
+
+	// RGBA images, including sub-images of larger ones, are read in place through their stride
+	if rgba, ok := img.(*image.RGBA); ok && !bounds.Empty() {
+		pixels := &rgba.Pix[rgba.PixOffset(bounds.Min.X, bounds.Min.Y)]
+		pinner.Pin(pixels)
+		input.format = C.POSTERIZE_PIXEL_FORMAT_RGBA
+		input.planes[0] = (*C.uint8_t)(unsafe.Pointer(pixels))
+		input.strides[0] = C.size_t(rgba.Stride)
+		return input
+	}
+
+	rgbaLinear := imageToLinearRGBA(img)
+	if len(rgbaLinear) > 0 {
+		pinner.Pin(&rgbaLinear[0])
+		input.planes[0] = (*C.uint8_t)(unsafe.Pointer(&rgbaLinear[0]))
+	}
+	input.format = C.POSTERIZE_PIXEL_FORMAT_RGBA
+	input.strides[0] = C.size_t(bounds.Dx() * 4)
+	return input
+}
+
+// Waits for an asynchronous posterization without tying up an OS thread: the job's eventfd is read
+// through Go's poller, which parks only the calling goroutine. The descriptor is duplicated because
+// the job owns and closes the original.
+func waitForJob(job *C.posterize_job) C.posterize_status {
+	if fd := int(C.posterizeJobEventFD(job)); fd >= 0 {
+		if eventFD, err := syscall.Dup(fd); err == nil {
+			file := os.NewFile(uintptr(eventFD), "posterize job")
+			var count [8]byte
+			file.Read(count[:])
+			file.Close()
+		}
+	}
+	return C.posterizeWaitJob(job)
 }
 
 func linearRGBAToImage(rgbaLinear []uint8, width, height int) *image.RGBA {
@@ -88,29 +161,71 @@ func saveImageToJPEG(image *image.RGBA, filePath string) error {
 }
 
 func main() {
+	rawInput := flag.String("raw", "", "file of raw RGBA frames to posterize instead of bouquet.jpg")
+	rawOutput := flag.String("out", "", "output file of palettes and 4-bit frames, for -raw")
+	frameWidth := flag.Int("width", 0, "frame width, for -raw")
+	frameHeight := flag.Int("height", 0, "frame height, for -raw")
+	seed := flag.Uint("seed", 0, "random seed, for -raw (0 seeds randomly)")
+	warmStart := flag.Bool("warm", false, "start each frame from the previous frame's palette, for -raw")
+	flag.Parse()
+	if *rawInput != "" {
+		numFrames, err := posterizeRawFrames(*rawInput, *rawOutput, *frameWidth, *frameHeight, uint32(*seed), *warmStart)
+		if err != nil {
+			fmt.Println("Error:", err)
+			os.Exit(1)
+		}
+		fmt.Printf("Posterized %d frames\n", numFrames)
+		return
+	}
+
 	buffer := make([]byte, 1024)
 	for i := 0; i < 1024; i++ {
 		buffer[i] = 1
 	}
 
 	filePath := "bouquet.jpg"
-	rgbaLinear, width, height, err := decodeJPEGToLinearRGBA(filePath)
+	img, err := decodeJPEG(filePath)
 	if err != nil {
 		fmt.Println("Error:", err)
 		return
 	}
+	width, height := img.Bounds().Dx(), img.Bounds().Dy()
+	var pinner runtime.Pinner
+	defer pinner.Unpin()
+	input := describeImage(img, &pinner)
 
 	// Posterize the image
 	image4bit := make([]uint8, width*height/2)
 	palette24bit := make([]uint8, 16*3)
+	rgbaLinear := make([]uint8, width*height*4)
 	cImage4bit := (*C.uchar)(&image4bit[0])
 	cPalette24bit := (*C.uchar)(&palette24bit[0])
-	cRgbaIn := (*C.uchar)(&rgbaLinear[0])
+	cRgbaOut := (*C.uchar)(&rgbaLinear[0])
 	cNumPixels := C.size_t(width * height)
-	C.posterize(cImage4bit, cPalette24bit, cRgbaIn, cNumPixels)
+	var ctx *C.posterize_ctx
+	if C.posterizeCreateContext(&ctx, nil) != C.POSTERIZE_OK {
+		fmt.Println("Error: unable to create posterization context")
+		return
+	}
+	defer C.posterizeDestroyContext(ctx)
+
+	// Posterize asynchronously. The outputs are written after the submitting call returns, so they
+	// are pinned like the input.
+	pinner.Pin(&image4bit[0])
+	pinner.Pin(&palette24bit[0])
+	var job *C.posterize_job
+	if C.posterizeSubmitImageWithContext(&job, ctx, cImage4bit, cPalette24bit, &input, nil) != C.POSTERIZE_OK {
+		fmt.Println("Error: unable to submit posterization")
+		return
+	}
+	defer C.posterizeReleaseJob(job)
+	if waitForJob(job) != C.POSTERIZE_OK {
+		fmt.Println("Error: posterization failed")
+		return
+	}
 
 	// Convert back so we will be able to write it to a JPEG image
-	C.applyColorsToPixelBuffer(cRgbaIn, cImage4bit, cPalette24bit, cNumPixels)
+	C.applyColorsToPixelBuffer(cRgbaOut, cImage4bit, cPalette24bit, cNumPixels)
 
 	// Convert linear RGBA to image
 	rgbaImage := linearRGBAToImage(rgbaLinear, width, height)
@@ -0,0 +1,353 @@
+/*
+ * nearest_centroid.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Nearest-centroid assignment kernels. The SIMD kernels test several pixels against all K
+ * centroids at once. Each pixel's squared distance is computed in a 32-bit lane and combined with
+ * the centroid index into a single key, (distance << log2(K)) | k, so that an unsigned minimum over
+ * the keys yields the nearest centroid with ties going to the lowest index, exactly like the scalar
+ * loop. Weighted metrics scale the differences by their weights before _mm_madd_epi16() multiplies
+ * them with the unscaled differences.
+ */
+
+#include "nearest_centroid.h"
+#include <algorithm>
+
+#ifdef POSTERIZE_X86
+#include <immintrin.h>
+#endif
+
+template <size_t K>
+void findNearestTwoScalar(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    constexpr unsigned shiftAmount = indexBits<K>();
+    for (size_t i = 0; i < numPixels; i++)
+    {
+        uint32_t nearest = UINT32_MAX;
+        uint32_t second = UINT32_MAX;
+        for (uint32_t k = 0; k < K; k++)
+        {
+            uint32_t key = (colorDistance<SquaredEuclidean>(centroids[k], rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2]) << shiftAmount) | k;
+            second = std::min(second, std::max(nearest, key));
+            nearest = std::min(nearest, key);
+        }
+        nearestKeys[i] = nearest;
+        secondNearestKeys[i] = second;
+    }
+}
+
+#ifdef POSTERIZE_X86
+
+/*
+ * SSE4.1: 8 pixels per loop iteration, in two vectors of 4.
+ *
+ * R and B are isolated into the low and high 16 bits of each 32-bit lane and G into the low 16
+ * bits, so that _mm_madd_epi16() squares and sums the differences directly in 32-bit precision.
+ */
+
+template <size_t K, typename Metric>
+__attribute__((target("sse4.1")))
+static inline __m128i distanceKeysSSE41(__m128i rb, __m128i g, const __m128i centroidRB[], const __m128i centroidG[])
+{
+    const __m128i weightRB = _mm_set1_epi32(int(Metric::kWeightR | (Metric::kWeightB << 16)));
+    const __m128i weightG = _mm_set1_epi32(int(Metric::kWeightG));
+    __m128i best = _mm_set1_epi32(-1);
+    for (size_t k = 0; k < K; k++)
+    {
+        __m128i drb = _mm_sub_epi16(rb, centroidRB[k]);
+        __m128i dg = _mm_sub_epi16(g, centroidG[k]);
+        __m128i weightedDRB = isUnweighted<Metric>() ? drb : _mm_mullo_epi16(drb, weightRB);
+        __m128i weightedDG = isUnweighted<Metric>() ? dg : _mm_mullo_epi16(dg, weightG);
+        __m128i distance = _mm_add_epi32(_mm_madd_epi16(drb, weightedDRB), _mm_madd_epi16(dg, weightedDG));
+        __m128i key = _mm_or_si128(_mm_slli_epi32(distance, indexBits<K>()), _mm_set1_epi32(int(k)));
+        best = _mm_min_epu32(best, key);
+    }
+    return _mm_and_si128(best, _mm_set1_epi32(int(K - 1)));
+}
+
+template <size_t K, typename Metric>
+__attribute__((target("sse4.1")))
+bool assignPixelsSSE41(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    __m128i centroidRB[K];
+    __m128i centroidG[K];
+    for (size_t k = 0; k < K; k++)
+    {
+        centroidRB[k] = _mm_set1_epi32(int(centroids[k].r) | (int(centroids[k].b) << 16));
+        centroidG[k] = _mm_set1_epi32(centroids[k].g);
+    }
+
+    const __m128i maskRB = _mm_set1_epi32(0x00ff00ff);
+    const __m128i maskG = _mm_set1_epi32(0x000000ff);
+    __m128i changed = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i *>(&rgba[i * 4]);
+        __m128i px0 = _mm_loadu_si128(p + 0);
+        __m128i px1 = _mm_loadu_si128(p + 1);
+
+        __m128i k0 = distanceKeysSSE41<K, Metric>(_mm_and_si128(px0, maskRB), _mm_and_si128(_mm_srli_epi32(px0, 8), maskG), centroidRB, centroidG);
+        __m128i k1 = distanceKeysSSE41<K, Metric>(_mm_and_si128(px1, maskRB), _mm_and_si128(_mm_srli_epi32(px1, 8), maskG), centroidRB, centroidG);
+
+        // Narrow the 32-bit labels to bytes
+        __m128i k = _mm_packus_epi16(_mm_packus_epi32(k0, k1), _mm_setzero_si128());
+        __m128i *l = reinterpret_cast<__m128i *>(&labels[i]);
+        changed = _mm_or_si128(changed, _mm_xor_si128(_mm_loadl_epi64(l), k));
+        _mm_storel_epi64(l, k);
+    }
+
+    bool didChange = !_mm_testz_si128(changed, changed);
+    return assignPixelsScalar<K, Metric>(&labels[i], &rgba[i * 4], numPixels - i, centroids) || didChange;
+}
+
+template <size_t K>
+__attribute__((target("sse4.1")))
+void findNearestTwoSSE41(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    __m128i centroidRB[K];
+    __m128i centroidG[K];
+    for (size_t k = 0; k < K; k++)
+    {
+        centroidRB[k] = _mm_set1_epi32(int(centroids[k].r) | (int(centroids[k].b) << 16));
+        centroidG[k] = _mm_set1_epi32(centroids[k].g);
+    }
+
+    const __m128i maskRB = _mm_set1_epi32(0x00ff00ff);
+    const __m128i maskG = _mm_set1_epi32(0x000000ff);
+    size_t i = 0;
+    for (; i + 4 <= numPixels; i += 4)
+    {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&rgba[i * 4]));
+        __m128i rb = _mm_and_si128(px, maskRB);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), maskG);
+        __m128i nearest = _mm_set1_epi32(-1);
+        __m128i second = _mm_set1_epi32(-1);
+        for (size_t k = 0; k < K; k++)
+        {
+            __m128i drb = _mm_sub_epi16(rb, centroidRB[k]);
+            __m128i dg = _mm_sub_epi16(g, centroidG[k]);
+            __m128i distance = _mm_add_epi32(_mm_madd_epi16(drb, drb), _mm_madd_epi16(dg, dg));
+            __m128i key = _mm_or_si128(_mm_slli_epi32(distance, indexBits<K>()), _mm_set1_epi32(int(k)));
+            second = _mm_min_epu32(second, _mm_max_epu32(nearest, key));
+            nearest = _mm_min_epu32(nearest, key);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&nearestKeys[i]), nearest);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&secondNearestKeys[i]), second);
+    }
+    findNearestTwoScalar<K>(&nearestKeys[i], &secondNearestKeys[i], &rgba[i * 4], numPixels - i, centroids);
+}
+
+/*
+ * AVX2: 16 pixels per loop iteration, in two vectors of 8. Same approach as SSE4.1.
+ */
+
+template <size_t K, typename Metric>
+__attribute__((target("avx2")))
+static inline __m256i distanceKeysAVX2(__m256i rb, __m256i g, const __m256i centroidRB[], const __m256i centroidG[])
+{
+    const __m256i weightRB = _mm256_set1_epi32(int(Metric::kWeightR | (Metric::kWeightB << 16)));
+    const __m256i weightG = _mm256_set1_epi32(int(Metric::kWeightG));
+    __m256i best = _mm256_set1_epi32(-1);
+    for (size_t k = 0; k < K; k++)
+    {
+        __m256i drb = _mm256_sub_epi16(rb, centroidRB[k]);
+        __m256i dg = _mm256_sub_epi16(g, centroidG[k]);
+        __m256i weightedDRB = isUnweighted<Metric>() ? drb : _mm256_mullo_epi16(drb, weightRB);
+        __m256i weightedDG = isUnweighted<Metric>() ? dg : _mm256_mullo_epi16(dg, weightG);
+        __m256i distance = _mm256_add_epi32(_mm256_madd_epi16(drb, weightedDRB), _mm256_madd_epi16(dg, weightedDG));
+        __m256i key = _mm256_or_si256(_mm256_slli_epi32(distance, indexBits<K>()), _mm256_set1_epi32(int(k)));
+        best = _mm256_min_epu32(best, key);
+    }
+    return _mm256_and_si256(best, _mm256_set1_epi32(int(K - 1)));
+}
+
+template <size_t K, typename Metric>
+__attribute__((target("avx2")))
+bool assignPixelsAVX2(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    __m256i centroidRB[K];
+    __m256i centroidG[K];
+    for (size_t k = 0; k < K; k++)
+    {
+        centroidRB[k] = _mm256_set1_epi32(int(centroids[k].r) | (int(centroids[k].b) << 16));
+        centroidG[k] = _mm256_set1_epi32(centroids[k].g);
+    }
+
+    const __m256i maskRB = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i maskG = _mm256_set1_epi32(0x000000ff);
+    __m128i changed = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        const __m256i *p = reinterpret_cast<const __m256i *>(&rgba[i * 4]);
+        __m256i px0 = _mm256_loadu_si256(p + 0);
+        __m256i px1 = _mm256_loadu_si256(p + 1);
+
+        __m256i k0 = distanceKeysAVX2<K, Metric>(_mm256_and_si256(px0, maskRB), _mm256_and_si256(_mm256_srli_epi32(px0, 8), maskG), centroidRB, centroidG);
+        __m256i k1 = distanceKeysAVX2<K, Metric>(_mm256_and_si256(px1, maskRB), _mm256_and_si256(_mm256_srli_epi32(px1, 8), maskG), centroidRB, centroidG);
+
+        // Narrow the 32-bit labels to bytes. The 256-bit packs operate within 128-bit lanes, so the
+        // 64-bit groups are put back in pixel order before the final pack.
+        __m256i k16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(k0, k1), 0xd8);
+        __m128i k = _mm_packus_epi16(_mm256_castsi256_si128(k16), _mm256_extracti128_si256(k16, 1));
+        __m128i *l = reinterpret_cast<__m128i *>(&labels[i]);
+        changed = _mm_or_si128(changed, _mm_xor_si128(_mm_loadu_si128(l), k));
+        _mm_storeu_si128(l, k);
+    }
+
+    bool didChange = !_mm_testz_si128(changed, changed);
+    return assignPixelsScalar<K, Metric>(&labels[i], &rgba[i * 4], numPixels - i, centroids) || didChange;
+}
+
+template <size_t K>
+__attribute__((target("avx2")))
+void findNearestTwoAVX2(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    __m256i centroidRB[K];
+    __m256i centroidG[K];
+    for (size_t k = 0; k < K; k++)
+    {
+        centroidRB[k] = _mm256_set1_epi32(int(centroids[k].r) | (int(centroids[k].b) << 16));
+        centroidG[k] = _mm256_set1_epi32(centroids[k].g);
+    }
+
+    const __m256i maskRB = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i maskG = _mm256_set1_epi32(0x000000ff);
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8)
+    {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&rgba[i * 4]));
+        __m256i rb = _mm256_and_si256(px, maskRB);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), maskG);
+        __m256i nearest = _mm256_set1_epi32(-1);
+        __m256i second = _mm256_set1_epi32(-1);
+        for (size_t k = 0; k < K; k++)
+        {
+            __m256i drb = _mm256_sub_epi16(rb, centroidRB[k]);
+            __m256i dg = _mm256_sub_epi16(g, centroidG[k]);
+            __m256i distance = _mm256_add_epi32(_mm256_madd_epi16(drb, drb), _mm256_madd_epi16(dg, dg));
+            __m256i key = _mm256_or_si256(_mm256_slli_epi32(distance, indexBits<K>()), _mm256_set1_epi32(int(k)));
+            second = _mm256_min_epu32(second, _mm256_max_epu32(nearest, key));
+            nearest = _mm256_min_epu32(nearest, key);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&nearestKeys[i]), nearest);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&secondNearestKeys[i]), second);
+    }
+    findNearestTwoScalar<K>(&nearestKeys[i], &secondNearestKeys[i], &rgba[i * 4], numPixels - i, centroids);
+}
+
+#endif  // POSTERIZE_X86
+
+// Instruction sets for which kernels exist
+enum class InstructionSet
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+static InstructionSet bestInstructionSet()
+{
+    static const InstructionSet isa = []()
+    {
+#ifdef POSTERIZE_X86
+        // cpuid-based feature detection
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return InstructionSet::AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            return InstructionSet::SSE41;
+        }
+#endif
+        return InstructionSet::Scalar;
+    }();
+    return isa;
+}
+
+template <size_t K, typename Metric>
+static AssignPixelsFn getAssignPixelsKernel()
+{
+    switch (bestInstructionSet())
+    {
+#ifdef POSTERIZE_X86
+    case InstructionSet::AVX2:
+        return assignPixelsAVX2<K, Metric>;
+    case InstructionSet::SSE41:
+        return assignPixelsSSE41<K, Metric>;
+#endif
+    default:
+        return assignPixelsScalar<K, Metric>;
+    }
+}
+
+template <typename Metric>
+static AssignPixelsFn getAssignPixelsKernel(size_t numCentroids)
+{
+    switch (numCentroids)
+    {
+    case 2:
+        return getAssignPixelsKernel<2, Metric>();
+    case 4:
+        return getAssignPixelsKernel<4, Metric>();
+    default:
+    case 16:
+        return getAssignPixelsKernel<16, Metric>();
+    case 256:
+        return getAssignPixelsKernel<256, Metric>();
+    }
+}
+
+template <size_t K>
+static FindNearestTwoFn getFindNearestTwoKernel()
+{
+    switch (bestInstructionSet())
+    {
+#ifdef POSTERIZE_X86
+    case InstructionSet::AVX2:
+        return findNearestTwoAVX2<K>;
+    case InstructionSet::SSE41:
+        return findNearestTwoSSE41<K>;
+#endif
+    default:
+        return findNearestTwoScalar<K>;
+    }
+}
+
+bool isSupportedClusterCount(size_t numCentroids)
+{
+    return numCentroids == 2 || numCentroids == 4 || numCentroids == 16 || numCentroids == 256;
+}
+
+AssignPixelsFn getAssignPixelsKernel(posterize_metric metric, size_t numCentroids)
+{
+    switch (metric)
+    {
+    default:
+    case POSTERIZE_METRIC_RGB:
+        return getAssignPixelsKernel<SquaredEuclidean>(numCentroids);
+    case POSTERIZE_METRIC_LUMA_WEIGHTED_RGB:
+        return getAssignPixelsKernel<LumaWeightedSquaredEuclidean>(numCentroids);
+    }
+}
+
+FindNearestTwoFn getFindNearestTwoKernel(size_t numCentroids)
+{
+    switch (numCentroids)
+    {
+    case 2:
+        return getFindNearestTwoKernel<2>();
+    case 4:
+        return getFindNearestTwoKernel<4>();
+    default:
+    case 16:
+        return getFindNearestTwoKernel<16>();
+    case 256:
+        return getFindNearestTwoKernel<256>();
+    }
+}
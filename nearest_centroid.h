@@ -0,0 +1,61 @@
+/*
+ * nearest_centroid.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Nearest-centroid assignment kernels used by the k-means loop, for each supported cluster count.
+ * Scalar, SSE4.1, and AVX2 versions are provided and the fastest one supported by the CPU is
+ * selected once at runtime. All kernels produce bit-identical results for a given metric.
+ */
+
+#ifndef NEAREST_CENTROID_H
+#define NEAREST_CENTROID_H
+
+#include "posterize.h"
+#include "kmeans_core.h"
+#include <cstddef>
+#include <cstdint>
+
+// Assigns each pixel of an RGBA buffer (alpha is ignored) to the centroid nearest to it (ties
+// resolved in favor of the lowest index) and writes the index to labels, one byte per pixel.
+// Returns true if any pixel's label changed. The number of centroids is fixed by the kernel.
+typedef bool (*AssignPixelsFn)(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+
+// The scalar kernel is the unrolled template core. The SIMD kernels are instantiated for each
+// cluster count and metric in nearest_centroid.cpp.
+template <size_t K, typename Metric>
+bool assignPixelsScalar(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[])
+{
+    return assignPixels<K, Metric>(labels, rgba, numPixels, centroids);
+}
+#ifdef POSTERIZE_X86
+template <size_t K, typename Metric>
+__attribute__((target("sse4.1"))) bool assignPixelsSSE41(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+template <size_t K, typename Metric>
+__attribute__((target("avx2"))) bool assignPixelsAVX2(uint8_t *labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+#endif
+
+// For each pixel of an RGBA buffer (alpha is ignored), finds the nearest and second nearest of K
+// centroids by squared Euclidean distance. Results are returned as keys, (distance^2 << b) | k,
+// where b = log2(K), so that the nearest centroid's index is nearestKeys[i] & (K - 1), and the
+// squared distances are nearestKeys[i] >> b and secondNearestKeys[i] >> b. Ties are resolved in
+// favor of the lowest index.
+typedef void (*FindNearestTwoFn)(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+
+template <size_t K>
+void findNearestTwoScalar(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+#ifdef POSTERIZE_X86
+template <size_t K>
+__attribute__((target("sse4.1"))) void findNearestTwoSSE41(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+template <size_t K>
+__attribute__((target("avx2"))) void findNearestTwoAVX2(uint32_t *nearestKeys, uint32_t *secondNearestKeys, const uint8_t *rgba, size_t numPixels, const Centroid centroids[]);
+#endif
+
+// Whether kernels exist for a cluster count: 2, 4, 16, or 256, one for each output bit depth
+extern bool isSupportedClusterCount(size_t numCentroids);
+
+// Return the best kernels for this CPU for a supported cluster count, the assignment kernel for the
+// given metric. Detection is performed only on the first call.
+extern AssignPixelsFn getAssignPixelsKernel(posterize_metric metric, size_t numCentroids);
+extern FindNearestTwoFn getFindNearestTwoKernel(size_t numCentroids);
+
+#endif // NEAREST_CENTROID_H
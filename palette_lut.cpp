@@ -0,0 +1,163 @@
+/*
+ * palette_lut.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Lookup table from quantized RGB colors to the index of the nearest palette color.
+ */
+
+#include "palette_lut.h"
+#include <algorithm>
+
+#ifdef POSTERIZE_X86
+#include <immintrin.h>
+
+/*
+ * AVX2: 16 pixels per loop iteration. Table indices are computed for 8 pixels at a time by masking
+ * and shifting each channel into place within the 32-bit pixel, and the entries are fetched with a
+ * gather. Gathers read 4 bytes, so the table is padded by 3 bytes.
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i lookupAVX2(__m256i px, const uint8_t *table, const __m256i masks[3], const __m128i shifts[3])
+{
+    __m256i r = _mm256_sll_epi32(_mm256_and_si256(px, masks[0]), shifts[0]);
+    __m256i g = _mm256_srl_epi32(_mm256_and_si256(px, masks[1]), shifts[1]);
+    __m256i b = _mm256_srl_epi32(_mm256_and_si256(px, masks[2]), shifts[2]);
+    __m256i index = _mm256_or_si256(_mm256_or_si256(r, g), b);
+    __m256i entries = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), index, 1);
+    return _mm256_and_si256(entries, _mm256_set1_epi32(0xff));
+}
+
+// Looks up pixels [0, numPixels) 16 at a time and returns the index of the first pixel left for
+// scalar code
+__attribute__((target("avx2")))
+static size_t lookupPixelsAVX2(uint8_t *indices, const uint8_t *rgba, size_t numPixels, const uint8_t *table, unsigned rBits, unsigned gBits, unsigned bBits)
+{
+    const unsigned rShift = 8 - rBits;
+    const unsigned gShift = 8 - gBits;
+    const unsigned bShift = 8 - bBits;
+    const __m256i masks[3] =
+    {
+        _mm256_set1_epi32((0xff << rShift) & 0xff),
+        _mm256_set1_epi32(((0xff << gShift) & 0xff) << 8),
+        _mm256_set1_epi32(((0xff << bShift) & 0xff) << 16)
+    };
+    const __m128i shifts[3] =
+    {
+        _mm_cvtsi32_si128(int(gBits + bBits - rShift)),     // left
+        _mm_cvtsi32_si128(int(8 + gShift - bBits)),         // right
+        _mm_cvtsi32_si128(int(16 + bShift))                 // right
+    };
+
+    size_t i = 0;
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        const __m256i *p = reinterpret_cast<const __m256i *>(&rgba[i * 4]);
+        __m256i k0 = lookupAVX2(_mm256_loadu_si256(p + 0), table, masks, shifts);
+        __m256i k1 = lookupAVX2(_mm256_loadu_si256(p + 1), table, masks, shifts);
+        __m256i k16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(k0, k1), 0xd8);
+        __m128i k = _mm_packus_epi16(_mm256_castsi256_si128(k16), _mm256_extracti128_si256(k16, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&indices[i]), k);
+    }
+    return i;
+}
+
+static bool hasAVX2()
+{
+    static const bool supported = []()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+}
+#endif
+
+void PaletteLUT::build(const Centroid palette[], size_t numColors, posterize_lut resolution, posterize_metric metric, const Workers &workers)
+{
+    auto isSameColor = [](const Centroid &a, const Centroid &b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b;
+    };
+    if (isBuilt() && resolution == m_resolution && metric == m_metric && numColors == m_numColors && std::equal(palette, palette + numColors, m_palette, isSameColor))
+    {
+        return;
+    }
+
+    bool is565 = resolution == POSTERIZE_LUT_565;
+    m_rBits = is565 ? 5 : 6;
+    m_gBits = 6;
+    m_bBits = is565 ? 5 : 6;
+    m_resolution = resolution;
+    m_metric = metric;
+    m_numColors = numColors;
+    std::copy(palette, palette + numColors, m_palette);
+    m_table.resize((size_t(1) << (m_rBits + m_gBits + m_bBits)) + 3);  // padded for SIMD gathers
+
+    // Each task fills the plane of cells with one red value, using the assignment kernel on the
+    // cell centers
+    AssignPixelsFn assignPixels = getAssignPixelsKernel(metric, numColors);
+    size_t numRed = size_t(1) << m_rBits;
+    size_t numGreen = size_t(1) << m_gBits;
+    size_t numBlue = size_t(1) << m_bBits;
+    workers.parallelFor(numRed, [&](size_t r)
+    {
+        uint8_t centers[64 * 64 * 4];
+        for (size_t g = 0; g < numGreen; g++)
+        {
+            for (size_t b = 0; b < numBlue; b++)
+            {
+                uint8_t *center = &centers[(g * numBlue + b) * 4];
+                center[0] = uint8_t((r << (8 - m_rBits)) + (0x80 >> m_rBits));
+                center[1] = uint8_t((g << (8 - m_gBits)) + (0x80 >> m_gBits));
+                center[2] = uint8_t((b << (8 - m_bBits)) + (0x80 >> m_bBits));
+                center[3] = 0;
+            }
+        }
+        assignPixels(&m_table[r * numGreen * numBlue], centers, numGreen * numBlue, m_palette);
+    });
+}
+
+void PaletteLUT::map(Labels labels, const uint8_t *rgba, size_t numPixels, const Workers &workers) const
+{
+    const uint8_t *table = m_table.data();
+    const unsigned rShift = 8 - m_rBits;
+    const unsigned gShift = 8 - m_gBits;
+    const unsigned bShift = 8 - m_bBits;
+    const unsigned gbBits = m_gBits + m_bBits;
+    const unsigned bBits = m_bBits;
+    auto lookup = [=](const uint8_t *pixel)
+    {
+        return table[(size_t(pixel[0] >> rShift) << gbBits) | (size_t(pixel[1] >> gShift) << bBits) | (pixel[2] >> bShift)];
+    };
+
+    // Each block is looked up into byte indices, which are then packed if the labels are
+    PixelChunks chunks(numPixels, workers.numThreads);
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        constexpr size_t blockSize = 1024;
+        uint8_t scratch[blockSize];
+        size_t chunkEnd = chunks.begin(chunk) + chunks.size(chunk);
+        for (size_t blockStart = chunks.begin(chunk); blockStart < chunkEnd; blockStart += blockSize)
+        {
+            size_t blockPixels = std::min(blockSize, chunkEnd - blockStart);
+            const uint8_t *pixels = &rgba[blockStart * 4];
+            uint8_t *indices = labels.isPacked() ? scratch : labels.byteAt(blockStart);
+            size_t i = 0;
+#ifdef POSTERIZE_X86
+            if (hasAVX2())
+            {
+                i = lookupPixelsAVX2(indices, pixels, blockPixels, table, m_rBits, m_gBits, m_bBits);
+            }
+#endif
+            for (; i < blockPixels; i++)
+            {
+                indices[i] = lookup(&pixels[i * 4]);
+            }
+            if (labels.isPacked())
+            {
+                packIndices(labels.byteAt(blockStart), indices, blockPixels, labels.bitsPerLabel);
+            }
+        }
+    });
+}
@@ -0,0 +1,45 @@
+/*
+ * palette_lut.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Lookup table from quantized RGB colors to the index of the nearest palette color, for mapping
+ * pixels to a fixed palette with one table lookup each.
+ */
+
+#ifndef PALETTE_LUT_H
+#define PALETTE_LUT_H
+
+#include "posterize.h"
+#include "kmeans.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class PaletteLUT
+{
+public:
+    // Fills the table for a palette of numColors colors, a supported cluster count, at the given
+    // resolution. Each cell holds the palette color nearest to the center of the cell by the given
+    // metric. Does nothing if the table already holds this palette at this resolution and metric.
+    void build(const Centroid palette[], size_t numColors, posterize_lut resolution, posterize_metric metric, const Workers &workers);
+
+    // Labels each pixel with the table entry for its color
+    void map(Labels labels, const uint8_t *rgba, size_t numPixels, const Workers &workers) const;
+
+    bool isBuilt() const
+    {
+        return !m_table.empty();
+    }
+
+private:
+    std::vector<uint8_t> m_table;
+    Centroid m_palette[kMaxCentroids] = {};
+    size_t m_numColors = 0;
+    posterize_lut m_resolution = POSTERIZE_LUT_NONE;
+    posterize_metric m_metric = POSTERIZE_METRIC_RGB;
+    unsigned m_rBits = 0;
+    unsigned m_gBits = 0;
+    unsigned m_bBits = 0;
+};
+
+#endif // PALETTE_LUT_H
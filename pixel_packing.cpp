@@ -0,0 +1,220 @@
+/*
+ * pixel_packing.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Conversion between one-byte palette indices and packed images of 1, 2, 4, or 8 bits per pixel.
+ */
+
+#include "pixel_packing.h"
+#include "kmeans_core.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef POSTERIZE_X86
+#include <immintrin.h>
+#endif
+
+// Packs pixels [i, numPixels), where i is the first pixel of a byte
+static bool packIndicesScalar(uint8_t *packed, const uint8_t *indices, size_t i, size_t numPixels, unsigned bitsPerPixel)
+{
+    const size_t pixelsPerByte = 8 / bitsPerPixel;
+    const unsigned fieldMask = (1u << bitsPerPixel) - 1;
+    uint8_t changed = 0;
+    for (; i < numPixels; i += pixelsPerByte)
+    {
+        size_t byteIdx = i / pixelsPerByte;
+        size_t count = std::min(pixelsPerByte, numPixels - i);
+        unsigned value = 0;
+        unsigned mask = 0;
+        for (size_t j = 0; j < count; j++)
+        {
+            unsigned shiftAmount = unsigned(pixelsPerByte - 1 - j) * bitsPerPixel;
+            value |= unsigned(indices[i + j]) << shiftAmount;
+            mask |= fieldMask << shiftAmount;
+        }
+        uint8_t newValue = uint8_t(value | (packed[byteIdx] & ~mask));
+        changed |= packed[byteIdx] ^ newValue;
+        packed[byteIdx] = newValue;
+    }
+    return changed != 0;
+}
+
+// Unpacks pixels [i, numPixels), where i is the first pixel of a byte
+static void unpackIndicesScalar(uint8_t *indices, const uint8_t *packed, size_t i, size_t numPixels, unsigned bitsPerPixel)
+{
+    const size_t pixelsPerByte = 8 / bitsPerPixel;
+    const unsigned fieldMask = (1u << bitsPerPixel) - 1;
+    for (; i < numPixels; i++)
+    {
+        unsigned shiftAmount = unsigned(pixelsPerByte - 1 - i % pixelsPerByte) * bitsPerPixel;
+        indices[i] = uint8_t((packed[i / pixelsPerByte] >> shiftAmount) & fieldMask);
+    }
+}
+
+#ifdef POSTERIZE_X86
+
+/*
+ * SSE4.1: 16 pixels, or 2 * Bits packed bytes, per loop iteration.
+ *
+ * Packing combines neighboring fields with multiply-adds: _mm_maddubs_epi16() with weights of
+ * (1 << Bits, 1) merges pairs of pixels and _mm_madd_epi16() merges pairs of pairs. 1-bit pixels
+ * are instead moved into the sign bits and collected with _mm_movemask_epi8() after reversing the
+ * order of each group of 8, so that the first pixel lands in the most significant bit.
+ *
+ * Unpacking copies each packed byte into the lanes of its pixels with _mm_shuffle_epi8() and then
+ * shifts each lane's field to the bottom by multiplying in 16-bit precision and keeping the high
+ * byte, since SSE has no per-lane variable shifts.
+ */
+
+static bool hasSSE41()
+{
+    static const bool supported = []()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+    }();
+    return supported;
+}
+
+// Packs pixels [0, numPixels) 16 at a time and returns the index of the first pixel left for
+// scalar code
+template <unsigned Bits>
+__attribute__((target("sse4.1")))
+static size_t packIndicesSSE41(bool *didChange, uint8_t *packed, const uint8_t *indices, size_t numPixels)
+{
+    constexpr size_t bytesPerBlock = 2 * Bits;
+    const __m128i reverseGroupsOf8 = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m128i pairWeights = _mm_set1_epi16(int16_t(0x0100 | (1 << Bits)));    // first pixel << Bits, second
+    const __m128i quadWeights = _mm_set1_epi32(0x00010000 | (1 << (2 * Bits)));   // first pair << 2 * Bits, second
+    uint64_t changed = 0;
+    __m128i changed8 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&indices[i]));
+        uint8_t *out = &packed[i * Bits / 8];
+        if constexpr (Bits == 8)
+        {
+            __m128i *p = reinterpret_cast<__m128i *>(out);
+            changed8 = _mm_or_si128(changed8, _mm_xor_si128(_mm_loadu_si128(p), k));
+            _mm_storeu_si128(p, k);
+            continue;
+        }
+
+        uint64_t value;
+        if constexpr (Bits == 1)
+        {
+            value = uint64_t(_mm_movemask_epi8(_mm_slli_epi16(_mm_shuffle_epi8(k, reverseGroupsOf8), 7)));
+        }
+        else if constexpr (Bits == 2)
+        {
+            __m128i quads = _mm_madd_epi16(_mm_maddubs_epi16(k, pairWeights), quadWeights);
+            __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(quads, quads), _mm_setzero_si128());
+            value = uint64_t(uint32_t(_mm_cvtsi128_si32(bytes)));
+        }
+        else
+        {
+            __m128i pairs = _mm_maddubs_epi16(k, pairWeights);
+            value = uint64_t(_mm_cvtsi128_si64(_mm_packus_epi16(pairs, pairs)));
+        }
+        uint64_t previous = 0;
+        memcpy(&previous, out, bytesPerBlock);
+        changed |= previous ^ value;
+        memcpy(out, &value, bytesPerBlock);
+    }
+    *didChange |= changed != 0 || !_mm_testz_si128(changed8, changed8);
+    return i;
+}
+
+// Unpacks pixels [0, numPixels) 16 at a time and returns the index of the first pixel left for
+// scalar code
+template <unsigned Bits>
+__attribute__((target("sse4.1")))
+static size_t unpackIndicesSSE41(uint8_t *indices, const uint8_t *packed, size_t numPixels)
+{
+    constexpr size_t bytesPerBlock = 2 * Bits;
+    constexpr size_t pixelsPerByte = 8 / Bits;
+    alignas(16) uint8_t selector[16];
+    alignas(16) uint16_t multipliers[16];
+    for (size_t lane = 0; lane < 16; lane++)
+    {
+        unsigned shiftAmount = unsigned(pixelsPerByte - 1 - lane % pixelsPerByte) * Bits;
+        selector[lane] = uint8_t(lane / pixelsPerByte);
+        multipliers[lane] = uint16_t(1u << (8 - shiftAmount));
+    }
+    const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(selector));
+    const __m128i multipliersLow = _mm_load_si128(reinterpret_cast<const __m128i *>(&multipliers[0]));
+    const __m128i multipliersHigh = _mm_load_si128(reinterpret_cast<const __m128i *>(&multipliers[8]));
+    const __m128i fieldMask = _mm_set1_epi16(int16_t((1 << Bits) - 1));
+
+    size_t i = 0;
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        uint64_t value = 0;
+        memcpy(&value, &packed[i * Bits / 8], bytesPerBlock);
+        __m128i bytes = _mm_shuffle_epi8(_mm_cvtsi64_si128(int64_t(value)), shuffle);
+        __m128i low = _mm_mullo_epi16(_mm_cvtepu8_epi16(bytes), multipliersLow);
+        __m128i high = _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(bytes, 8)), multipliersHigh);
+        low = _mm_and_si128(_mm_srli_epi16(low, 8), fieldMask);
+        high = _mm_and_si128(_mm_srli_epi16(high, 8), fieldMask);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&indices[i]), _mm_packus_epi16(low, high));
+    }
+    return i;
+}
+
+#endif  // POSTERIZE_X86
+
+bool packIndices(uint8_t *packed, const uint8_t *indices, size_t numPixels, unsigned bitsPerPixel)
+{
+    bool didChange = false;
+    size_t i = 0;
+#ifdef POSTERIZE_X86
+    if (hasSSE41())
+    {
+        switch (bitsPerPixel)
+        {
+        case 1:
+            i = packIndicesSSE41<1>(&didChange, packed, indices, numPixels);
+            break;
+        case 2:
+            i = packIndicesSSE41<2>(&didChange, packed, indices, numPixels);
+            break;
+        case 4:
+            i = packIndicesSSE41<4>(&didChange, packed, indices, numPixels);
+            break;
+        default:
+            i = packIndicesSSE41<8>(&didChange, packed, indices, numPixels);
+            break;
+        }
+    }
+#endif
+    return packIndicesScalar(packed, indices, i, numPixels, bitsPerPixel) || didChange;
+}
+
+void unpackIndices(uint8_t *indices, const uint8_t *packed, size_t numPixels, unsigned bitsPerPixel)
+{
+    if (bitsPerPixel == 8)
+    {
+        memcpy(indices, packed, numPixels);
+        return;
+    }
+    size_t i = 0;
+#ifdef POSTERIZE_X86
+    if (hasSSE41())
+    {
+        switch (bitsPerPixel)
+        {
+        case 1:
+            i = unpackIndicesSSE41<1>(indices, packed, numPixels);
+            break;
+        case 2:
+            i = unpackIndicesSSE41<2>(indices, packed, numPixels);
+            break;
+        default:
+            i = unpackIndicesSSE41<4>(indices, packed, numPixels);
+            break;
+        }
+    }
+#endif
+    unpackIndicesScalar(indices, packed, i, numPixels, bitsPerPixel);
+}
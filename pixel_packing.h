@@ -0,0 +1,36 @@
+/*
+ * pixel_packing.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Conversion between one-byte palette indices and packed images of 1, 2, 4, or 8 bits per pixel.
+ * Packed pixels fill each byte from the most significant bits down, so that the first pixel of a
+ * byte is in its top bits, as in the 4-bit images produced by posterize().
+ */
+
+#ifndef PIXEL_PACKING_H
+#define PIXEL_PACKING_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Whether bitsPerPixel is a supported depth: 1, 2, 4, or 8
+inline bool isValidBitsPerPixel(unsigned bitsPerPixel)
+{
+    return bitsPerPixel == 1 || bitsPerPixel == 2 || bitsPerPixel == 4 || bitsPerPixel == 8;
+}
+
+// Number of bytes occupied by numPixels packed pixels
+inline size_t packedSize(size_t numPixels, unsigned bitsPerPixel)
+{
+    return (numPixels * bitsPerPixel + 7) / 8;
+}
+
+// Packs indices, each less than 1 << bitsPerPixel, starting at the first pixel of byte packed[0].
+// Bits of a final, partially filled byte that lie beyond the last pixel are left unchanged. Returns
+// true if any byte changed.
+extern bool packIndices(uint8_t *packed, const uint8_t *indices, size_t numPixels, unsigned bitsPerPixel);
+
+// Unpacks numPixels indices starting at the first pixel of byte packed[0]
+extern void unpackIndices(uint8_t *indices, const uint8_t *packed, size_t numPixels, unsigned bitsPerPixel);
+
+#endif // PIXEL_PACKING_H
@@ -5,10 +5,35 @@
  * Image posterization: converts RGB images to 4-bit palettized images for display on Frame.
  */
 
+#include "posterize.h"
+#include "hamerly.h"
+#include "image_stream.h"
+#include "input_image.h"
+#include "kmeans.h"
+#include "palette_lut.h"
+#include "pixel_packing.h"
+#include "sampling.h"
+#include "scratch_arena.h"
+#include "seeding.h"
+#include "task_queue.h"
+#include "weighted_colors.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 struct PaletteValue
 {
@@ -24,12 +49,12 @@ struct PaletteValue
     }
 };
 
-static void setDarkestColorToBlackAndIndex0(PaletteValue palette[], uint8_t *image4bit, size_t numBytes)
+static void setDarkestColorToBlackAndIndex0(PaletteValue palette[], size_t numColors, uint8_t *image, size_t numPixels, unsigned bitsPerPixel)
 {
     // Find darkest color
     float darkestLuma = 1.0f;
     size_t darkestColor = 0;
-    for (size_t i = 0; i < 16; i++)
+    for (size_t i = 0; i < numColors; i++)
     {
         float luma = palette[i].luminance();
         if (luma < darkestLuma)
@@ -53,162 +78,953 @@ static void setDarkestColorToBlackAndIndex0(PaletteValue palette[], uint8_t *ima
     palette[0] = palette[darkestColor];
     palette[darkestColor] = tmp;
 
-    // Construct a LUT that swaps occurrences of 0 <-> darkestColor for each 4-bit pixel
+    // Construct a LUT that swaps occurrences of 0 <-> darkestColor in each pixel of a byte
     uint8_t lut[256];
-    for (size_t i = 0; i < 256; i++)
+    const unsigned pixelMask = (1u << bitsPerPixel) - 1;
+    for (unsigned i = 0; i < 256; i++)
     {
-        lut[i] = i;
+        unsigned value = 0;
+        for (unsigned shiftAmount = 0; shiftAmount < 8; shiftAmount += bitsPerPixel)
+        {
+            unsigned colorIdx = (i >> shiftAmount) & pixelMask;
+            colorIdx = colorIdx == 0 ? unsigned(darkestColor) : (colorIdx == darkestColor ? 0 : colorIdx);
+            value |= colorIdx << shiftAmount;
+        }
+        lut[i] = uint8_t(value);
     }
-    lut[0x00 | 0x00] = (darkestColor << 4) | darkestColor;  // (0, 0) -> (darkestColor, darkestColor)
-    lut[0x00 | darkestColor] = (darkestColor << 4) | 0x00;  // (0, darkestColor) -> (darkestColor, 0)
-    lut[(darkestColor << 4) | 0x00] = 0x00 | darkestColor;  // (darkestColor, 0) -> (0, darkestColor)
-    lut[(darkestColor << 4) | darkestColor] = 0x00;         // (darkestColor, darkestColor) -> (0, 0)
 
     // Remap pixels using the LUT
+    size_t numBytes = packedSize(numPixels, bitsPerPixel);
     for (size_t i = 0; i < numBytes; i++)
     {
-        image4bit[i] = lut[image4bit[i]];
+        image[i] = lut[image[i]];
+    }
+}
+
+// Options, random number generator, threads, and scratch memory for a sequence of posterize calls
+struct posterize_ctx
+{
+    posterize_options options;
+    std::mt19937 rng;
+    Workers workers;
+    ScratchArena scratch;
+
+    // Centroids from which the next frame starts when warm starting
+    Centroid previousCentroids[kMaxCentroids];
+    bool hasPreviousCentroids = false;
+
+    // Table for the final assignment, kept while the palette is unchanged
+    PaletteLUT finalLUT;
+
+    posterize_ctx(const posterize_options &options)
+        : options(options),
+          rng(options.seed),
+          workers{ ThreadPool::shared(), options.numThreads == 0 ? ThreadPool::shared().numThreads() : options.numThreads }
+    {
+        if (options.seed == 0)
+        {
+            std::random_device dev;
+            rng.seed(dev());
+        }
+    }
+};
+
+// Posterization running on the task queue. Its state is only touched under the mutex once the
+// job has been submitted.
+struct posterize_job
+{
+    posterize_ctx *ctx;
+    std::unique_ptr<posterize_ctx> ownedCtx;    // when submitted with options rather than a context
+    uint8_t *image;
+    uint8_t *palette24bit;
+    posterize_image input;
+    posterize_stats *stats;
+
+    std::mutex mutex;
+    std::condition_variable completed;
+    bool isComplete = false;
+    posterize_status status = POSTERIZE_OK;
+    int eventFD = -1;
+
+    ~posterize_job()
+    {
+#ifdef __linux__
+        if (eventFD >= 0)
+        {
+            close(eventFD);
+        }
+#endif
+    }
+};
+
+// Lookup table for a fixed palette
+struct posterize_palette_lut
+{
+    PaletteLUT lut;
+};
+
+// Chooses the initial centroids. Seeding always looks at the pixels themselves, so that all engines
+// start from the same centroids. Warm starts pick up where the previous frame left off.
+static void seedOrWarmStart(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, posterize_ctx &ctx)
+{
+    if (ctx.options.warmStart && ctx.hasPreviousCentroids)
+    {
+        std::copy(ctx.previousCentroids, ctx.previousCentroids + numCentroids, centroids);
+    }
+    else
+    {
+        seedCentroids(centroids, numCentroids, rgba, numPixels, ctx.options.seeding, ctx.rng, ctx.workers);
+    }
+}
+
+// Iteration limits and tolerances from the options, with the time budget counted from start
+static KMeansLimits getKMeansLimits(const posterize_options &options, std::chrono::steady_clock::time_point start)
+{
+    KMeansLimits limits;
+    limits.maxIterations = options.maxIterations;
+    limits.maxChangedFraction = options.changedLabelTolerance;
+    limits.maxCentroidShift = options.centroidTolerance;
+    if (options.timeBudgetMs > 0.0f)
+    {
+        limits.deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(options.timeBudgetMs));
+    }
+    return limits;
+}
+
+// Fits centroids to colors weighted by pixel count, for the engines that cluster a summary of the
+// pixels rather than the pixels themselves
+static KMeansResult fitWeightedColors(Centroid centroids[], size_t numCentroids, const WeightedColors &colors, const KMeansLimits &limits, posterize_ctx &ctx, double *meanSquaredError)
+{
+    Labels colorLabels{ ctx.scratch.allocate<uint8_t>(colors.size()), 8 };
+    KMeansResult result = runKMeans(centroids, numCentroids, colorLabels, colors.rgba, colors.counts, colors.size(), limits, ctx.workers, ctx.options.metric);
+    if (meanSquaredError)
+    {
+        *meanSquaredError = measureMeanSquaredError(colorLabels, colors.rgba, colors.counts, colors.size(), centroids, ctx.workers);
+    }
+    return result;
+}
+
+// Fits centroids to pixels with the selected engine. Returns the number of iterations performed and
+// why they stopped. If isAssigned is set on return, labels holds each pixel's final cluster index;
+// otherwise, the pixels still need to be assigned to the centroids. Engines that assign pixels one
+// by one use an assignment cache if cacheStats is not null. If meanSquaredError is not null, it
+// receives the error of the points clustered.
+static KMeansResult fitCentroids(Centroid centroids[], size_t numCentroids, bool *isAssigned, Labels labels, const uint8_t *rgba, size_t numPixels, const KMeansLimits &limits, posterize_ctx &ctx, AssignmentCacheStats *cacheStats, double *meanSquaredError)
+{
+    const posterize_options &options = ctx.options;
+    const Workers &workers = ctx.workers;
+    ScratchArena &scratch = ctx.scratch;
+    seedOrWarmStart(centroids, numCentroids, rgba, numPixels, ctx);
+
+    *isAssigned = false;
+    KMeansResult result;
+    switch (options.engine)
+    {
+    default:
+    case POSTERIZE_ENGINE_PIXELS:
+        *isAssigned = true;
+        result = runKMeans(centroids, numCentroids, labels, rgba, nullptr, numPixels, limits, workers, options.metric, cacheStats);
+        break;
+    case POSTERIZE_ENGINE_HAMERLY:
+        *isAssigned = true;
+        result = runKMeansHamerly(centroids, numCentroids, labels, rgba, numPixels, limits, workers, scratch);
+        break;
+    case POSTERIZE_ENGINE_HISTOGRAM:
+    {
+        bool is565 = options.histogram == POSTERIZE_HISTOGRAM_565;
+        WeightedColors histogram = buildColorHistogram(rgba, numPixels, is565 ? 5 : 6, 6, is565 ? 5 : 6, workers, scratch);
+        return fitWeightedColors(centroids, numCentroids, histogram, limits, ctx, meanSquaredError);
+    }
+    case POSTERIZE_ENGINE_UNIQUE_COLORS:
+    {
+        WeightedColors colors = buildUniqueColors(rgba, numPixels, scratch);
+        return fitWeightedColors(centroids, numCentroids, colors, limits, ctx, meanSquaredError);
+    }
+    }
+    if (meanSquaredError)
+    {
+        *meanSquaredError = measureMeanSquaredError(labels, rgba, nullptr, numPixels, centroids, workers);
+    }
+    return result;
+}
+
+// Assigns pixels to the nearest of the final centroids, through the context's lookup table if one
+// was built for them
+static void assignPixelsToPalette(Labels labels, const uint8_t *rgba, size_t numPixels, const Centroid centroids[], size_t numColors, posterize_ctx &ctx, AssignmentCacheStats *cacheStats)
+{
+    if (ctx.options.finalLUT != POSTERIZE_LUT_NONE)
+    {
+        ctx.finalLUT.map(labels, rgba, numPixels, ctx.workers);
+    }
+    else
+    {
+        assignPixelsParallel(labels, rgba, numPixels, centroids, numColors, ctx.workers, ctx.options.metric, cacheStats);
+    }
+}
+
+// Assigns every pixel of an image to the nearest of the final centroids, through the context's
+// lookup table if enabled. Images that are not RGBA are converted a band of rows at a time.
+static void assignFinalLabels(Labels labels, const InputImage &input, const Centroid centroids[], size_t numColors, posterize_ctx &ctx, AssignmentCacheStats *cacheStats)
+{
+    const posterize_options &options = ctx.options;
+    if (options.finalLUT != POSTERIZE_LUT_NONE)
+    {
+        ctx.finalLUT.build(centroids, numColors, options.finalLUT, options.metric, ctx.workers);
+    }
+    auto assign = [&](Labels bandLabels, const uint8_t *rgba, size_t numPixels)
+    {
+        assignPixelsToPalette(bandLabels, rgba, numPixels, centroids, numColors, ctx, cacheStats);
+    };
+
+    size_t numPixels = input.numPixels();
+    if (input.rgba())
+    {
+        assign(labels, input.rgba(), numPixels);
+        return;
+    }
+
+    // Bands are a multiple of 16 pixels so that they start on byte boundaries of packed labels
+    constexpr size_t bandSize = size_t(1) << 18;
+    uint8_t *band = ctx.scratch.allocate<uint8_t>(std::min(bandSize, numPixels) * 4);
+    for (size_t bandStart = 0; bandStart < numPixels; bandStart += bandSize)
+    {
+        size_t bandPixels = std::min(bandSize, numPixels - bandStart);
+        input.convertParallel(band, bandStart, bandPixels, ctx.workers);
+        assign(Labels{ labels.byteAt(bandStart), labels.bitsPerLabel }, band, bandPixels);
+    }
+}
+
+// Ends a posterize call: saves the centroids for a warm start, reports statistics, and writes the
+// palette, with the darkest color forced to black and moved to index 0
+static void finishPosterize(posterize_ctx &ctx, uint8_t *image, uint8_t *palette24bit, const Centroid centroids[], size_t numPixels, const KMeansResult &result, double meanSquaredError, const AssignmentCacheStats &cacheStats, posterize_stats *stats)
+{
+    const posterize_options &options = ctx.options;
+    const size_t numColors = size_t(1) << options.bitsPerPixel;
+    ctx.scratch.reset();    // sizes the arena for the next call
+    std::copy(centroids, centroids + numColors, ctx.previousCentroids);
+    ctx.hasPreviousCentroids = true;
+    if (stats)
+    {
+        stats->iterations = result.iterations;
+        stats->assignmentRunHits = cacheStats.runHits;
+        stats->assignmentCacheHits = cacheStats.cacheHits;
+        stats->assignmentMisses = cacheStats.misses;
+        stats->stopReason = result.stopReason;
+        stats->meanSquaredError = meanSquaredError;
+    }
+
+    // Create palette
+    PaletteValue palette[kMaxCentroids];
+    for (size_t i = 0; i < numColors; i++)
+    {
+        palette[i] = { .r = centroids[i].r, .g = centroids[i].g, .b = centroids[i].b };
+    }
+
+    // Force darkest color to black and make that color index 0. On Frame, color 0 is
+    // transparent.
+    setDarkestColorToBlackAndIndex0(palette, numColors, image, numPixels, options.bitsPerPixel);
+
+    // Copy out the palette
+    for (size_t i = 0; i < numColors; i++)
+    {
+        palette24bit[i * 3 + 0] = palette[i].r;
+        palette24bit[i * 3 + 1] = palette[i].g;
+        palette24bit[i * 3 + 2] = palette[i].b;
+    }
+}
+
+static void posterizeImpl(posterize_ctx &ctx, uint8_t *image, uint8_t *palette24bit, const InputImage &input, posterize_stats *stats)
+{
+    // The time budget includes everything up to clustering
+    const KMeansLimits limits = getKMeansLimits(ctx.options, std::chrono::steady_clock::now());
+
+    // Palette
+    const posterize_options &options = ctx.options;
+    const size_t numColors = size_t(1) << options.bitsPerPixel;
+    const size_t numPixels = input.numPixels();
+
+    // An empty image has nothing to cluster, and converting other layouts to RGBA would divide by a
+    // width of 0. The palette is all black, and the warm start palette is left as is.
+    if (numPixels == 0)
+    {
+        std::fill(palette24bit, palette24bit + numColors * 3, 0);
+        if (stats)
+        {
+            *stats = posterize_stats{};
+            stats->stopReason = POSTERIZE_STOP_CONVERGED;
+        }
+        return;
+    }
+
+    // Scratch memory is normally released at the end of clustering, but not if it was interrupted
+    // by an exception
+    ctx.scratch.reset();
+
+    // Cluster, reading RGBA input in place. The cluster index of each pixel (color is just the
+    // cluster index, k) is written straight into the packed output image. When training on a
+    // subsample, a final full-resolution pass assigns all pixels. Other layouts are converted to
+    // RGBA as they are read, except that clustering every pixel needs a converted copy of the image.
+    Labels labels{ image, options.bitsPerPixel };
+    AssignmentCacheStats cacheStats;
+    AssignmentCacheStats *cacheStatsIfEnabled = options.assignmentCache ? &cacheStats : nullptr;
+    Centroid centroids[kMaxCentroids];
+    bool isAssigned = false;
+    KMeansResult result;
+    double meanSquaredError = 0;
+    double *meanSquaredErrorIfRequested = stats ? &meanSquaredError : nullptr;
+    if (options.sampleRatio < 1.0f)
+    {
+        size_t numSamples = 0;
+        const uint8_t *samples = samplePixels(&numSamples, input, options.sampleRatio, options.sampling, ctx.rng, ctx.workers, ctx.scratch);
+        Labels sampleLabels{ ctx.scratch.allocate<uint8_t>(numSamples), 8 };
+        result = fitCentroids(centroids, numColors, &isAssigned, sampleLabels, samples, numSamples, limits, ctx, cacheStatsIfEnabled, meanSquaredErrorIfRequested);
+        assignFinalLabels(labels, input, centroids, numColors, ctx, cacheStatsIfEnabled);
+    }
+    else
+    {
+        const uint8_t *rgba = input.rgba();
+        if (!rgba)
+        {
+            uint8_t *converted = ctx.scratch.allocate<uint8_t>(numPixels * 4);
+            input.convertParallel(converted, 0, numPixels, ctx.workers);
+            rgba = converted;
+        }
+        result = fitCentroids(centroids, numColors, &isAssigned, labels, rgba, numPixels, limits, ctx, cacheStatsIfEnabled, meanSquaredErrorIfRequested);
+        if (!isAssigned)
+        {
+            assignFinalLabels(labels, InputImage::fromRGBA(rgba, numPixels), centroids, numColors, ctx, cacheStatsIfEnabled);
+        }
+    }
+    finishPosterize(ctx, image, palette24bit, centroids, numPixels, result, meanSquaredError, cacheStats, stats);
+}
+
+// Largest sample drawn from a streamed image, which bounds the memory used to seed and, when
+// training on a sample, to fit the centroids
+constexpr size_t kMaxStreamSamples = size_t(1) << 22;
+
+static void posterizeStreamImpl(posterize_ctx &ctx, uint8_t *image, uint8_t *palette24bit, const posterize_stream &streamDescription, posterize_stats *stats)
+{
+    const KMeansLimits limits = getKMeansLimits(ctx.options, std::chrono::steady_clock::now());
+    const posterize_options &options = ctx.options;
+    const size_t numColors = size_t(1) << options.bitsPerPixel;
+    ctx.scratch.reset();
+    ImageStream stream(streamDescription, ctx.scratch);
+    const size_t numPixels = stream.numPixels();
+
+    // A first pass draws a bounded sample. Training on every pixel then takes one pass per
+    // iteration, with labels written straight into the packed output image; training on the sample
+    // takes just a final pass to assign all pixels.
+    size_t numSamples = std::clamp(size_t(std::llround(double(numPixels) * options.sampleRatio)), size_t(1), std::min(numPixels, kMaxStreamSamples));
+    const uint8_t *samples = sampleStream(stream, numSamples, ctx.workers, ctx.scratch);
+    Labels labels{ image, options.bitsPerPixel };
+    AssignmentCacheStats cacheStats;
+    AssignmentCacheStats *cacheStatsIfEnabled = options.assignmentCache ? &cacheStats : nullptr;
+    Centroid centroids[kMaxCentroids];
+    KMeansResult result;
+    double meanSquaredError = 0;
+    if (options.sampleRatio < 1.0f)
+    {
+        bool isAssigned = false;
+        Labels sampleLabels{ ctx.scratch.allocate<uint8_t>(numSamples), 8 };
+        result = fitCentroids(centroids, numColors, &isAssigned, sampleLabels, samples, numSamples, limits, ctx, cacheStatsIfEnabled, stats ? &meanSquaredError : nullptr);
+        if (options.finalLUT != POSTERIZE_LUT_NONE)
+        {
+            ctx.finalLUT.build(centroids, numColors, options.finalLUT, options.metric, ctx.workers);
+        }
+        for (size_t band = 0; band < stream.numBands(); band++)
+        {
+            const uint8_t *rgba = stream.read(band, ctx.workers);
+            Labels bandLabels{ labels.byteAt(stream.bandStart(band)), labels.bitsPerLabel };
+            assignPixelsToPalette(bandLabels, rgba, stream.bandPixels(band), centroids, numColors, ctx, cacheStatsIfEnabled);
+        }
+    }
+    else
+    {
+        seedOrWarmStart(centroids, numColors, samples, numSamples, ctx);
+        result = runStreamingKMeans(centroids, numColors, labels, stream, samples, numSamples, limits, ctx.workers, options.metric);
+
+        // The error is estimated on the sample rather than with another pass over the stream
+        if (stats)
+        {
+            Labels sampleLabels{ ctx.scratch.allocate<uint8_t>(numSamples), 8 };
+            assignPixelsParallel(sampleLabels, samples, numSamples, centroids, numColors, ctx.workers, options.metric);
+            meanSquaredError = measureMeanSquaredError(sampleLabels, samples, nullptr, numSamples, centroids, ctx.workers);
+        }
+    }
+    finishPosterize(ctx, image, palette24bit, centroids, numPixels, result, meanSquaredError, cacheStats, stats);
+}
+
+// Posterizes one image of a batch. The context is reseeded for each image, if seeded at all, so
+// that results do not depend on which context processes which images.
+static void posterizeBatchItem(posterize_ctx &ctx, posterize_batch_item &item)
+{
+    if (!InputImage::isValid(item.input))
+    {
+        item.status = POSTERIZE_ERROR_INVALID_ARGUMENT;
+        return;
+    }
+    if (ctx.options.seed != 0)
+    {
+        ctx.rng.seed(ctx.options.seed);
+    }
+
+    try
+    {
+        posterizeImpl(ctx, item.image, item.palette24bit, InputImage(item.input), item.stats);
+        item.status = POSTERIZE_OK;
+    }
+    catch (const std::bad_alloc &)
+    {
+        item.status = POSTERIZE_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+// Runs a job on a task queue thread and signals its completion. Waiters are notified with the mutex
+// held, because a waiter may free the job as soon as it can observe completion.
+static void runJob(posterize_job &job)
+{
+    posterize_status status = POSTERIZE_OK;
+    try
+    {
+        posterizeImpl(*job.ctx, job.image, job.palette24bit, InputImage(job.input), job.stats);
+    }
+    catch (const std::bad_alloc &)
+    {
+        status = POSTERIZE_ERROR_OUT_OF_MEMORY;
+    }
+
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.status = status;
+    job.isComplete = true;
+#ifdef __linux__
+    if (job.eventFD >= 0)
+    {
+        eventfd_write(job.eventFD, 1);
+    }
+#endif
+    job.completed.notify_all();
+}
+
+// Queues a job whose inputs are set
+static void submitJob(posterize_job **job, std::unique_ptr<posterize_job> newJob)
+{
+    *job = newJob.release();
+    posterize_job *submitted = *job;
+    TaskQueue::shared().submit([submitted]() { runJob(*submitted); });
+}
+
+static bool areOptionsValid(const posterize_options &options)
+{
+    if (options.engine != POSTERIZE_ENGINE_PIXELS && options.engine != POSTERIZE_ENGINE_HISTOGRAM && options.engine != POSTERIZE_ENGINE_UNIQUE_COLORS && options.engine != POSTERIZE_ENGINE_HAMERLY)
+    {
+        return false;
+    }
+    if (options.histogram != POSTERIZE_HISTOGRAM_565 && options.histogram != POSTERIZE_HISTOGRAM_666)
+    {
+        return false;
+    }
+    if (!(options.sampleRatio > 0.0f && options.sampleRatio <= 1.0f))
+    {
+        return false;
+    }
+    if (options.sampling != POSTERIZE_SAMPLING_STRIDE && options.sampling != POSTERIZE_SAMPLING_RANDOM && options.sampling != POSTERIZE_SAMPLING_BOX)
+    {
+        return false;
+    }
+    if (options.seeding != POSTERIZE_SEEDING_RANDOM_LABELS && options.seeding != POSTERIZE_SEEDING_KMEANS_PLUS_PLUS && options.seeding != POSTERIZE_SEEDING_LUMINANCE_QUANTILES)
+    {
+        return false;
+    }
+    if (options.finalLUT != POSTERIZE_LUT_NONE && options.finalLUT != POSTERIZE_LUT_565 && options.finalLUT != POSTERIZE_LUT_666)
+    {
+        return false;
+    }
+    if (options.metric != POSTERIZE_METRIC_RGB && (options.metric != POSTERIZE_METRIC_LUMA_WEIGHTED_RGB || options.engine == POSTERIZE_ENGINE_HAMERLY))
+    {
+        return false;
     }
+    if (!isValidBitsPerPixel(options.bitsPerPixel))
+    {
+        return false;
+    }
+    if (options.maxIterations == 0 || !(options.timeBudgetMs >= 0.0f && std::isfinite(options.timeBudgetMs)))
+    {
+        return false;
+    }
+    if (!(options.changedLabelTolerance >= 0.0f && options.changedLabelTolerance <= 1.0f) || !(options.centroidTolerance >= 0.0f && std::isfinite(options.centroidTolerance)))
+    {
+        return false;
+    }
+    return true;
 }
 
 extern "C"
 {
     void posterize(uint8_t *image4bit, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels)
     {
-        // Palette
-        size_t numColors = 16;
-        PaletteValue palette[numColors];
+        posterizeWithOptions(image4bit, palette24bit, rgbaIn, numPixels, nullptr, nullptr);
+    }
+
+    void posterizeDefaultOptions(posterize_options *options)
+    {
+        options->numThreads = 0;
+        options->engine = POSTERIZE_ENGINE_PIXELS;
+        options->histogram = POSTERIZE_HISTOGRAM_666;
+        options->seed = 0;
+        options->sampleRatio = 1.0f;
+        options->sampling = POSTERIZE_SAMPLING_STRIDE;
+        options->seeding = POSTERIZE_SEEDING_RANDOM_LABELS;
+        options->warmStart = 0;
+        options->finalLUT = POSTERIZE_LUT_NONE;
+        options->assignmentCache = 0;
+        options->metric = POSTERIZE_METRIC_RGB;
+        options->bitsPerPixel = 4;
+        options->maxIterations = kMaxIterations;
+        options->timeBudgetMs = 0.0f;
+        options->changedLabelTolerance = 0.0f;
+        options->centroidTolerance = 0.0f;
+    }
+
+    posterize_status posterizeWithOptions(uint8_t *image, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels, const posterize_options *options, posterize_stats *stats)
+    {
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if (!areOptionsValid(*options))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
 
-        // Make a local copy of RGBA buffer so we can safely clobber alpha channel
-        size_t numBytes = numPixels * 4;
-        std::unique_ptr<uint8_t[]> rgba = std::make_unique<uint8_t[]>(numBytes);
-        memcpy(rgba.get(), rgbaIn, numBytes);
+        try
+        {
+            posterize_ctx ctx(*options);
+            posterizeImpl(ctx, image, palette24bit, InputImage::fromRGBA(rgbaIn, numPixels), stats);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
 
-        // Randomize assignment of pixels to the k clusters, using alpha channel
-        std::random_device dev;
-        std::mt19937 rng(dev());
-        std::uniform_int_distribution<std::mt19937::result_type> random(0, unsigned(numColors - 1));   // [0, numColors-1]
-        for (size_t i = 0; i < numBytes; i += 4)
+    posterize_status posterizeImageWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_image *input, const posterize_options *options, posterize_stats *stats)
+    {
+        if (!input)
         {
-            rgba[i + 3] = random(rng);
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
         }
+        return posterizeScaledImageWithOptions(image, palette24bit, input, input->width, input->height, options, stats);
+    }
 
-        // Centroid for each color cluster (mean RGB value)
-        struct Color
+    posterize_status posterizeScaledImageWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_image *input, size_t width, size_t height, const posterize_options *options, posterize_stats *stats)
+    {
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if (!input || !InputImage::isValid(*input) || !InputImage::isValidScale(*input, width, height) || !areOptionsValid(*options))
         {
-            uint64_t r = 0;
-            uint64_t g = 0;
-            uint64_t b = 0;
-        };
-        Color centroids[numColors];
-        int numPixelsInCluster[numColors];
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
 
-        // Repeat k-means until complete
-        size_t maxIterations = 24;
-        size_t iterations = 0;
-        bool didChange = false;
-        do {
-            didChange = false;
+        try
+        {
+            posterize_ctx ctx(*options);
+            posterizeImpl(ctx, image, palette24bit, InputImage(*input, width, height), stats);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
 
-            // Compute average for each cluster
-            for (size_t i = 0; i < numColors; i++)
-            {
-                centroids[i] = Color(); // zero out
-                numPixelsInCluster[i] = 0;
-            }
-            for (size_t i = 0; i < numBytes; i += 4)
-            {
-                size_t k = rgba[i + 3];
-                centroids[k].r += rgba[i + 0];
-                centroids[k].g += rgba[i + 1];
-                centroids[k].b += rgba[i + 2];
-                numPixelsInCluster[k]++;
-            }
-            for (size_t i = 0; i < numColors; i++)
+    posterize_status posterizeStreamWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_stream *stream, const posterize_options *options, posterize_stats *stats)
+    {
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if (!stream || !ImageStream::isValid(*stream) || !areOptionsValid(*options))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            posterize_ctx ctx(*options);
+            posterizeStreamImpl(ctx, image, palette24bit, *stream, stats);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        catch (const StreamReadError &)
+        {
+            return POSTERIZE_ERROR_READ_FAILED;
+        }
+        return POSTERIZE_OK;
+    }
+
+    posterize_status posterizeBatch(posterize_batch_item *items, size_t numItems, const posterize_options *options)
+    {
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if ((!items && numItems != 0) || !areOptionsValid(*options))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+        posterize_options batchOptions = *options;
+        batchOptions.warmStart = 0;
+
+        try
+        {
+            // Images that can occupy every thread are processed one at a time with all of them
+            posterize_ctx ctx(batchOptions);
+            size_t numThreads = std::min(ctx.workers.numThreads, ctx.workers.pool.numThreads());
+            std::vector<size_t> smallItems;
+            for (size_t i = 0; i < numItems; i++)
             {
-                if (numPixelsInCluster[i] != 0)
+                const posterize_image &input = items[i].input;
+                bool isLarge = InputImage::isValid(input) && PixelChunks(input.width * input.height, numThreads).count() >= numThreads;
+                if (numThreads > 1 && !isLarge)
+                {
+                    smallItems.push_back(i);
+                }
+                else
                 {
-                    centroids[i].r /= numPixelsInCluster[i];
-                    centroids[i].g /= numPixelsInCluster[i];
-                    centroids[i].b /= numPixelsInCluster[i];
+                    posterizeBatchItem(ctx, items[i]);
                 }
             }
 
-            // Assign each pixel to nearest cluster (cluster whose centroid is nearest)
-            for (size_t i = 0; i < numBytes; i += 4)
+            // Smaller ones are handed out to single-threaded contexts, one per thread, as each
+            // thread becomes free
+            posterize_options itemOptions = batchOptions;
+            itemOptions.numThreads = 1;
+            std::vector<std::unique_ptr<posterize_ctx>> threadContexts(std::min(numThreads, smallItems.size()));
+            for (std::unique_ptr<posterize_ctx> &threadContext : threadContexts)
+            {
+                threadContext = std::make_unique<posterize_ctx>(itemOptions);
+            }
+            std::atomic<size_t> nextItem{ 0 };
+            ctx.workers.parallelFor(threadContexts.size(), [&](size_t thread)
             {
-                // Compute distance^2 to each cluster centroid
-                uint64_t distance[numColors];
-                for (size_t j = 0; j < numColors; j++)
+                for (size_t i = nextItem++; i < smallItems.size(); i = nextItem++)
                 {
-                    uint64_t dr = centroids[j].r - rgba[i + 0];
-                    uint64_t dg = centroids[j].g - rgba[i + 1];
-                    uint64_t db = centroids[j].b - rgba[i + 2];
-                    distance[j] = dr * dr + dg * dg + db * db;
+                    posterizeBatchItem(*threadContexts[thread], items[smallItems[i]]);
                 }
+            });
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
 
-                // Which is nearest?
-                size_t bestK = 0;
-                size_t nearestDistance = distance[0];
-                for (size_t j = 1; j < numColors; j++)
-                {
-                    if (distance[j] < nearestDistance)
-                    {
-                        nearestDistance = distance[j];
-                        bestK = j;
-                    }
-                }
+    posterize_status posterizeWithPalette(uint8_t *image4bit, const uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels)
+    {
+        Centroid centroids[kNumCentroids];
+        for (size_t i = 0; i < kNumCentroids; i++)
+        {
+            centroids[i] = { .r = palette24bit[i * 3 + 0], .g = palette24bit[i * 3 + 1], .b = palette24bit[i * 3 + 2] };
+        }
 
-                // Did an assignment change?
-                didChange |= rgba[i + 3] != bestK;
+        try
+        {
+            ThreadPool &pool = ThreadPool::shared();
+            assignPixelsParallel(Labels{ image4bit, 4 }, rgbaIn, numPixels, centroids, kNumCentroids, Workers{ pool, pool.numThreads() }, POSTERIZE_METRIC_RGB);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
 
-                // Assign
-                rgba[i + 3] = bestK;
-            }
+    posterize_status posterizeCreatePaletteLUT(posterize_palette_lut **lut, const uint8_t *palette24bit, posterize_lut resolution)
+    {
+        *lut = nullptr;
+        if (resolution != POSTERIZE_LUT_565 && resolution != POSTERIZE_LUT_666)
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+        Centroid palette[kNumCentroids];
+        for (size_t i = 0; i < kNumCentroids; i++)
+        {
+            palette[i] = { .r = palette24bit[i * 3 + 0], .g = palette24bit[i * 3 + 1], .b = palette24bit[i * 3 + 2] };
+        }
 
-            iterations++;
-        } while (didChange && iterations < maxIterations);
+        try
+        {
+            std::unique_ptr<posterize_palette_lut> newLUT = std::make_unique<posterize_palette_lut>();
+            ThreadPool &pool = ThreadPool::shared();
+            newLUT->lut.build(palette, kNumCentroids, resolution, POSTERIZE_METRIC_RGB, Workers{ pool, pool.numThreads() });
+            *lut = newLUT.release();
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
 
-        // Create palette
-        for (size_t i = 0; i < numColors; i++)
+    posterize_status posterizeWithPaletteLUT(uint8_t *image4bit, const posterize_palette_lut *lut, const uint8_t *rgbaIn, size_t numPixels)
+    {
+        if (!lut)
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+        ThreadPool &pool = ThreadPool::shared();
+        lut->lut.map(Labels{ image4bit, 4 }, rgbaIn, numPixels, Workers{ pool, pool.numThreads() });
+        return POSTERIZE_OK;
+    }
+
+    void posterizeDestroyPaletteLUT(posterize_palette_lut *lut)
+    {
+        delete lut;
+    }
+
+    posterize_status posterizeCreateContext(posterize_ctx **ctx, const posterize_options *options)
+    {
+        *ctx = nullptr;
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if (!areOptionsValid(*options))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            *ctx = new posterize_ctx(*options);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
+
+    posterize_status posterizeWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels, posterize_stats *stats)
+    {
+        if (!ctx)
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            posterizeImpl(*ctx, image, palette24bit, InputImage::fromRGBA(rgbaIn, numPixels), stats);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
+
+    posterize_status posterizeImageWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, posterize_stats *stats)
+    {
+        if (!input)
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+        return posterizeScaledImageWithContext(ctx, image, palette24bit, input, input->width, input->height, stats);
+    }
+
+    posterize_status posterizeScaledImageWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, size_t width, size_t height, posterize_stats *stats)
+    {
+        if (!ctx || !input || !InputImage::isValid(*input) || !InputImage::isValidScale(*input, width, height))
         {
-            palette[i] = { .r = uint8_t(centroids[i].r), .g = uint8_t(centroids[i].g), .b = uint8_t(centroids[i].b) };
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
         }
 
-        // Assign colors to output pixels
-        for (size_t i = 0; i < numPixels; i++)
+        try
+        {
+            posterizeImpl(*ctx, image, palette24bit, InputImage(*input, width, height), stats);
+        }
+        catch (const std::bad_alloc &)
         {
-            uint8_t colorIdx = rgba[i * 4 + 3]; // color is just the cluster index, k
-            size_t byteIdx = i / 2;
-            size_t shiftAmount = (~i & 1) * 4;  // even pixel in high nibble, odd in low
-            uint8_t mask = 0xf0 >> shiftAmount; // mask if reverse: mask off low nibble when writing high nibble, etc.
-            image4bit[byteIdx] = (image4bit[byteIdx] & mask) | (colorIdx << shiftAmount);
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
         }
+        return POSTERIZE_OK;
+    }
 
-        // Force darkest color to black and make that color index 0. On Frame, color 0 is
-        // transparent.
-        setDarkestColorToBlackAndIndex0(palette, image4bit, numPixels / 2);
+    posterize_status posterizeStreamWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_stream *stream, posterize_stats *stats)
+    {
+        if (!ctx || !stream || !ImageStream::isValid(*stream))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            posterizeStreamImpl(*ctx, image, palette24bit, *stream, stats);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        catch (const StreamReadError &)
+        {
+            return POSTERIZE_ERROR_READ_FAILED;
+        }
+        return POSTERIZE_OK;
+    }
 
-        // Copy out the palette
+    posterize_status posterizeSetContextPalette(posterize_ctx *ctx, const uint8_t *palette24bit)
+    {
+        if (!ctx || !palette24bit)
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+        size_t numColors = size_t(1) << ctx->options.bitsPerPixel;
         for (size_t i = 0; i < numColors; i++)
         {
-            palette24bit[i * 3 + 0] = palette[i].r;
-            palette24bit[i * 3 + 1] = palette[i].g;
-            palette24bit[i * 3 + 2] = palette[i].b;
+            ctx->previousCentroids[i] = { .r = palette24bit[i * 3 + 0], .g = palette24bit[i * 3 + 1], .b = palette24bit[i * 3 + 2] };
+        }
+        ctx->hasPreviousCentroids = true;
+        return POSTERIZE_OK;
+    }
+
+    void posterizeDestroyContext(posterize_ctx *ctx)
+    {
+        delete ctx;
+    }
+
+    posterize_status posterizeSubmitImage(posterize_job **job, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, const posterize_options *options, posterize_stats *stats)
+    {
+        *job = nullptr;
+        posterize_options defaultOptions;
+        if (!options)
+        {
+            posterizeDefaultOptions(&defaultOptions);
+            options = &defaultOptions;
+        }
+        if (!input || !InputImage::isValid(*input) || !areOptionsValid(*options))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            std::unique_ptr<posterize_job> newJob = std::make_unique<posterize_job>();
+            newJob->ownedCtx = std::make_unique<posterize_ctx>(*options);
+            newJob->ctx = newJob->ownedCtx.get();
+            newJob->image = image;
+            newJob->palette24bit = palette24bit;
+            newJob->input = *input;
+            newJob->stats = stats;
+            submitJob(job, std::move(newJob));
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
+
+    posterize_status posterizeSubmitImageWithContext(posterize_job **job, posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, posterize_stats *stats)
+    {
+        *job = nullptr;
+        if (!ctx || !input || !InputImage::isValid(*input))
+        {
+            return POSTERIZE_ERROR_INVALID_ARGUMENT;
+        }
+
+        try
+        {
+            std::unique_ptr<posterize_job> newJob = std::make_unique<posterize_job>();
+            newJob->ctx = ctx;
+            newJob->image = image;
+            newJob->palette24bit = palette24bit;
+            newJob->input = *input;
+            newJob->stats = stats;
+            submitJob(job, std::move(newJob));
+        }
+        catch (const std::bad_alloc &)
+        {
+            return POSTERIZE_ERROR_OUT_OF_MEMORY;
+        }
+        return POSTERIZE_OK;
+    }
+
+    int posterizePollJob(posterize_job *job)
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        return job->isComplete ? 1 : 0;
+    }
+
+    posterize_status posterizeWaitJob(posterize_job *job)
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->completed.wait(lock, [job]() { return job->isComplete; });
+        return job->status;
+    }
+
+    int posterizeJobEventFD(posterize_job *job)
+    {
+#ifdef __linux__
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (job->eventFD < 0)
+        {
+            job->eventFD = eventfd(job->isComplete ? 1 : 0, EFD_CLOEXEC | EFD_NONBLOCK);
+        }
+        return job->eventFD;
+#else
+        (void) job;
+        return -1;
+#endif
+    }
+
+    void posterizeReleaseJob(posterize_job *job)
+    {
+        if (job)
+        {
+            posterizeWaitJob(job);
+            delete job;
         }
     }
 
     void applyColorsToPixelBuffer(uint8_t *rgba, const uint8_t *image4bit, const uint8_t *palette24bit, size_t numPixels)
     {
-        for (size_t i = 0; i < numPixels; i++)
+        applyColorsToPixelBufferWithDepth(rgba, image4bit, palette24bit, numPixels, 4);
+    }
+
+    void applyColorsToPixelBufferWithDepth(uint8_t *rgba, const uint8_t *image, const uint8_t *palette24bit, size_t numPixels, unsigned bitsPerPixel)
+    {
+        // Unpack a block of color indices at a time. Blocks start on byte boundaries at any depth.
+        constexpr size_t blockSize = 1024;
+        uint8_t colorIndices[blockSize];
+        for (size_t blockStart = 0; blockStart < numPixels; blockStart += blockSize)
         {
-            size_t byteIdx = i / 2;
-            size_t shiftAmount = (~i & 1) * 4;  // even pixel in high nibble, odd in low
-            uint8_t colorIdx = (image4bit[byteIdx] >> shiftAmount) & 0xf;  // extract color value in nibble
-            rgba[i * 4 + 0] = palette24bit[colorIdx * 3 + 0];   // r
-            rgba[i * 4 + 1] = palette24bit[colorIdx * 3 + 1];   // g
-            rgba[i * 4 + 2] = palette24bit[colorIdx * 3 + 2];   // b
-            rgba[i * 4 + 3] = 0xff;                             // a
+            size_t blockPixels = std::min(blockSize, numPixels - blockStart);
+            unpackIndices(colorIndices, &image[blockStart * bitsPerPixel / 8], blockPixels, bitsPerPixel);
+            for (size_t i = 0; i < blockPixels; i++)
+            {
+                uint8_t colorIdx = colorIndices[i];
+                uint8_t *pixel = &rgba[(blockStart + i) * 4];
+                pixel[0] = palette24bit[colorIdx * 3 + 0];  // r
+                pixel[1] = palette24bit[colorIdx * 3 + 1];  // g
+                pixel[2] = palette24bit[colorIdx * 3 + 2];  // b
+                pixel[3] = 0xff;                            // a
+            }
         }
     }
-}
\ No newline at end of file
+}
@@ -11,6 +11,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * Posterizes an image: reduces the color palette to 16 colors, with color 0 forced to black, and 
  * produces a 4-bit linear palettized image.
@@ -30,6 +34,932 @@
  */
 extern void posterize(uint8_t *image4bit, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels);
 
+/*
+ * Status codes returned by functions that can fail.
+ */
+typedef enum posterize_status
+{
+    POSTERIZE_OK = 0,
+    POSTERIZE_ERROR_INVALID_ARGUMENT,
+    POSTERIZE_ERROR_OUT_OF_MEMORY,
+    POSTERIZE_ERROR_READ_FAILED
+} posterize_status;
+
+/*
+ * k-means engines.
+ *
+ * POSTERIZE_ENGINE_PIXELS:
+ *      Clusters every pixel on every iteration. This is the reference engine.
+ * POSTERIZE_ENGINE_HISTOGRAM:
+ *      Builds a color histogram first and clusters its occupied bins, weighted by their pixel
+ *      counts, followed by a single full-resolution pass to assign pixels to the final palette.
+ *      Iterations cost time proportional to the number of occupied bins rather than pixels. The
+ *      result is an approximation whose quality depends on the histogram resolution.
+ * POSTERIZE_ENGINE_UNIQUE_COLORS:
+ *      Compacts the image into its unique 24-bit colors and clusters those, weighted by their pixel
+ *      counts. Produces exactly the same result as POSTERIZE_ENGINE_PIXELS given the same seed,
+ *      with iterations that are cheaper by the ratio of pixels to unique colors. Best suited to
+ *      screenshots and images with large flat regions.
+ * POSTERIZE_ENGINE_HAMERLY:
+ *      Clusters every pixel, like POSTERIZE_ENGINE_PIXELS and with exactly the same result, but
+ *      keeps per-pixel distance bounds (Hamerly's algorithm) that let most pixels skip the distance
+ *      computation once the palette begins to settle. Needs 8 additional bytes per pixel. With
+ *      only 16 clusters the vectorized search of POSTERIZE_ENGINE_PIXELS is usually faster.
+ */
+typedef enum posterize_engine
+{
+    POSTERIZE_ENGINE_PIXELS = 0,
+    POSTERIZE_ENGINE_HISTOGRAM,
+    POSTERIZE_ENGINE_UNIQUE_COLORS,
+    POSTERIZE_ENGINE_HAMERLY
+} posterize_engine;
+
+/*
+ * Histogram resolutions for POSTERIZE_ENGINE_HISTOGRAM, in bits per R, G, and B channel.
+ */
+typedef enum posterize_histogram
+{
+    POSTERIZE_HISTOGRAM_565 = 0,    // 64K bins
+    POSTERIZE_HISTOGRAM_666         // 256K bins
+} posterize_histogram;
+
+/*
+ * Pixel sampling methods used when posterize_options.sampleRatio is less than 1.
+ *
+ * POSTERIZE_SAMPLING_STRIDE:
+ *      Evenly spaced pixels.
+ * POSTERIZE_SAMPLING_RANDOM:
+ *      Uniformly random pixels, drawn with replacement.
+ * POSTERIZE_SAMPLING_BOX:
+ *      Downscaled copy: each sample is the mean of a run of consecutive pixels. Because only the
+ *      pixel count is known, this is a horizontal box filter that may span row boundaries.
+ */
+typedef enum posterize_sampling
+{
+    POSTERIZE_SAMPLING_STRIDE = 0,
+    POSTERIZE_SAMPLING_RANDOM,
+    POSTERIZE_SAMPLING_BOX
+} posterize_sampling;
+
+/*
+ * Strategies for choosing the initial palette.
+ *
+ * POSTERIZE_SEEDING_RANDOM_LABELS:
+ *      Assigns each pixel to a random cluster. Every initial centroid is then close to the mean
+ *      color of the image, so k-means often needs many iterations.
+ * POSTERIZE_SEEDING_KMEANS_PLUS_PLUS:
+ *      k-means++ on a sample of up to 4096 pixels: centroids are drawn one at a time, each with
+ *      probability proportional to its squared distance from those already chosen.
+ * POSTERIZE_SEEDING_LUMINANCE_QUANTILES:
+ *      Deterministic. Orders pixels by luminance, splits them into one equally sized group per
+ *      palette color, and uses the mean color of each group.
+ */
+typedef enum posterize_seeding
+{
+    POSTERIZE_SEEDING_RANDOM_LABELS = 0,
+    POSTERIZE_SEEDING_KMEANS_PLUS_PLUS,
+    POSTERIZE_SEEDING_LUMINANCE_QUANTILES
+} posterize_seeding;
+
+/*
+ * Lookup tables mapping quantized colors to palette indices, named by the bits per R, G, and B
+ * channel. Each of the 32x64x32 or 64x64x64 cells maps to the palette color nearest its center, so
+ * a pixel near the boundary between two palette colors may map to the one that is slightly
+ * farther away.
+ */
+typedef enum posterize_lut
+{
+    POSTERIZE_LUT_NONE = 0,
+    POSTERIZE_LUT_565,
+    POSTERIZE_LUT_666
+} posterize_lut;
+
+/*
+ * Distance metrics by which pixels are assigned to the nearest palette color.
+ *
+ * POSTERIZE_METRIC_RGB:
+ *      Squared Euclidean distance in RGB.
+ * POSTERIZE_METRIC_LUMA_WEIGHTED_RGB:
+ *      Squared differences of R, G, and B weighted 3:6:1, roughly their contributions to ITU
+ *      BT.601 luminance, so that the palette spends more of its colors on distinguishing greens
+ *      and fewer on blues.
+ */
+typedef enum posterize_metric
+{
+    POSTERIZE_METRIC_RGB = 0,
+    POSTERIZE_METRIC_LUMA_WEIGHTED_RGB
+} posterize_metric;
+
+/*
+ * Reasons that k-means stops iterating, reported in posterize_stats.
+ *
+ * POSTERIZE_STOP_CONVERGED:
+ *      An iteration changed no assignments.
+ * POSTERIZE_STOP_ITERATION_LIMIT:
+ *      posterize_options.maxIterations iterations were performed.
+ * POSTERIZE_STOP_TOLERANCE:
+ *      The palette came within posterize_options.changedLabelTolerance or
+ *      posterize_options.centroidTolerance of converging.
+ * POSTERIZE_STOP_TIME_BUDGET:
+ *      Another iteration would have overrun posterize_options.timeBudgetMs.
+ */
+typedef enum posterize_stop_reason
+{
+    POSTERIZE_STOP_CONVERGED = 0,
+    POSTERIZE_STOP_ITERATION_LIMIT,
+    POSTERIZE_STOP_TOLERANCE,
+    POSTERIZE_STOP_TIME_BUDGET
+} posterize_stop_reason;
+
+/*
+ * Options controlling how posterization is performed. Always initialize with
+ * posterizeDefaultOptions() before modifying individual fields.
+ *
+ * Fields
+ * ------
+ * numThreads:
+ *      Maximum number of threads, including the calling thread, that k-means may use. Threads are
+ *      drawn from a pool shared by all calls. 0 (the default) uses all hardware threads and 1 runs
+ *      everything on the calling thread. Results do not depend on the number of threads.
+ * engine:
+ *      k-means engine. Defaults to POSTERIZE_ENGINE_PIXELS.
+ * histogram:
+ *      Histogram resolution used by POSTERIZE_ENGINE_HISTOGRAM. Defaults to
+ *      POSTERIZE_HISTOGRAM_666.
+ * seed:
+ *      Seed for the random number generator used to initialize clustering. 0 (the default) draws a
+ *      fresh seed on each call. Any other value makes the result reproducible.
+ * sampleRatio:
+ *      Fraction of pixels, in (0, 1], on which the engine fits the palette. When less than 1 (the
+ *      default is 1), the engine runs on a subsample and a single full-resolution pass then
+ *      assigns every pixel to the nearest palette color. See the README for the quality/speed
+ *      tradeoff.
+ * sampling:
+ *      How the subsample is drawn. Defaults to POSTERIZE_SAMPLING_STRIDE.
+ * seeding:
+ *      How the initial palette is chosen. Defaults to POSTERIZE_SEEDING_RANDOM_LABELS.
+ * warmStart:
+ *      If nonzero, frames processed with a context start from the previous frame's palette (or one
+ *      given with posterizeSetContextPalette()) instead of a newly seeded one. Consecutive video
+ *      frames then typically converge in a few iterations. The first frame is seeded as usual.
+ *      Has no effect without a context. Defaults to 0.
+ * finalLUT:
+ *      If not POSTERIZE_LUT_NONE, the final full-resolution assignment that follows fitting on
+ *      something other than every pixel (sampleRatio < 1, POSTERIZE_ENGINE_HISTOGRAM, or
+ *      POSTERIZE_ENGINE_UNIQUE_COLORS) maps pixels through a lookup table built from the palette
+ *      rather than computing distances. A context keeps the table while the palette is unchanged.
+ *      Defaults to POSTERIZE_LUT_NONE.
+ * assignmentCache:
+ *      If nonzero, pixels are assigned to clusters through a cache: a pixel with the same color as
+ *      the previous pixel, or as one in a small cache of recently searched colors, reuses that
+ *      result instead of computing distances. Results are unchanged. Applies to
+ *      POSTERIZE_ENGINE_PIXELS and to the final full-resolution assignment. Hit counts are
+ *      reported in posterize_stats. Mainly a measurement tool: with 16 colors the vectorized
+ *      distance computation costs about as much as a lookup, so only images made almost entirely
+ *      of flat regions break even. Defaults to 0.
+ * metric:
+ *      Distance metric used to assign pixels to clusters and to the final palette. Defaults to
+ *      POSTERIZE_METRIC_RGB. POSTERIZE_ENGINE_HAMERLY supports only POSTERIZE_METRIC_RGB.
+ * bitsPerPixel:
+ *      Output depth: 1, 2, 4, or 8 bits per pixel, producing a palette of 2, 4, 16, or 256 colors,
+ *      respectively. Pixels are packed from the most significant bits of each byte down, so that
+ *      the first pixel of a byte is in its top bits. Defaults to 4.
+ * maxIterations:
+ *      Maximum number of k-means iterations, at least 1. Defaults to 24.
+ * timeBudgetMs:
+ *      If greater than 0, the time in milliseconds, counted from the start of the call, after which
+ *      k-means stops iterating and keeps the palette it has. Iterations are never interrupted:
+ *      k-means stops before any iteration that, taking as long as the one before it, would end
+ *      past the budget. Preparation such as seeding and building histograms, and the final
+ *      full-resolution assignment, always run to completion, so calls can take somewhat longer
+ *      than the budget. Results then depend on timing. Defaults to 0, meaning no budget.
+ * changedLabelTolerance:
+ *      If greater than 0, k-means stops after an iteration that reassigns no more than this
+ *      fraction, in [0, 1], of the pixels it clusters. Histogram bins and unique colors count for
+ *      as many pixels as they stand for. Defaults to 0, meaning that iterations continue until
+ *      none changes.
+ * centroidTolerance:
+ *      If greater than 0, k-means stops when no palette color would move by more than this
+ *      distance in RGB units (0 to 255 per channel), keeping the palette against which pixels were
+ *      last assigned. Defaults to 0.
+ */
+typedef struct posterize_options
+{
+    size_t numThreads;
+    posterize_engine engine;
+    posterize_histogram histogram;
+    uint32_t seed;
+    float sampleRatio;
+    posterize_sampling sampling;
+    posterize_seeding seeding;
+    int warmStart;
+    posterize_lut finalLUT;
+    int assignmentCache;
+    posterize_metric metric;
+    unsigned bitsPerPixel;
+    size_t maxIterations;
+    float timeBudgetMs;
+    float changedLabelTolerance;
+    float centroidTolerance;
+} posterize_options;
+
+/*
+ * Statistics describing a completed posterization.
+ *
+ * Fields
+ * ------
+ * iterations:
+ *      Number of k-means iterations performed. Each iteration assigns every point to its nearest
+ *      centroid. Iterations stop when no assignment changes or a limit set in posterize_options is
+ *      reached, by default 24 iterations.
+ * assignmentRunHits:
+ *      With posterize_options.assignmentCache, the number of pixel assignments, summed over all
+ *      iterations, that reused the result of the previous pixel. Otherwise 0.
+ * assignmentCacheHits:
+ *      Likewise, the number that were found in the cache.
+ * assignmentMisses:
+ *      Likewise, the number that required computing distances.
+ * stopReason:
+ *      Why iterations stopped.
+ * meanSquaredError:
+ *      Mean squared RGB distance from each point clustered to its palette color, before the
+ *      darkest color is forced to black: the k-means objective that iterations reduce. Points are
+ *      weighted by pixel count for POSTERIZE_ENGINE_HISTOGRAM and POSTERIZE_ENGINE_UNIQUE_COLORS.
+ *      With sampleRatio < 1, and for streamed images, it is measured on the sampled pixels.
+ */
+typedef struct posterize_stats
+{
+    size_t iterations;
+    size_t assignmentRunHits;
+    size_t assignmentCacheHits;
+    size_t assignmentMisses;
+    posterize_stop_reason stopReason;
+    double meanSquaredError;
+} posterize_stats;
+
+/*
+ * Fills in the default options, which are those used by posterize().
+ *
+ * Parameters
+ * ----------
+ * options:
+ *      Options structure to initialize.
+ */
+extern void posterizeDefaultOptions(posterize_options *options);
+
+/*
+ * Same as posterize() but with explicit options.
+ *
+ * Parameters
+ * ----------
+ * image:
+ *      Output buffer to which the image, packed at options->bitsPerPixel bits per pixel, will be
+ *      written. Must be of size (numPixels * bitsPerPixel + 7) / 8. It also holds the cluster
+ *      labels while clustering, so that rgbaIn is read in place and never copied.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * rgbaIn:
+ *      Input RGBA buffer. Alpha is ignored.
+ * numPixels:
+ *      The total number of pixels (i.e., height * width).
+ * options:
+ *      Options. If NULL, the defaults are used.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeWithOptions(uint8_t *image, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels, const posterize_options *options, posterize_stats *stats);
+
+/*
+ * Pixel layouts accepted by posterize_image.
+ *
+ * POSTERIZE_PIXEL_FORMAT_RGBA:
+ *      Interleaved R, G, B, and A bytes in plane 0. Alpha is ignored.
+ * POSTERIZE_PIXEL_FORMAT_I420:
+ *      Planar YCbCr 4:2:0: Y in plane 0 and Cb and Cr in planes 1 and 2, each subsampled by 2
+ *      horizontally and vertically ((width + 1) / 2 by (height + 1) / 2 samples).
+ * POSTERIZE_PIXEL_FORMAT_I422:
+ *      Planar YCbCr 4:2:2: like I420, but Cb and Cr are subsampled only horizontally.
+ * POSTERIZE_PIXEL_FORMAT_I444:
+ *      Planar YCbCr 4:4:4: Y, Cb, and Cr planes of equal size.
+ * POSTERIZE_PIXEL_FORMAT_NV12:
+ *      Semi-planar YCbCr 4:2:0: Y in plane 0 and interleaved Cb, Cr pairs in plane 1.
+ * POSTERIZE_PIXEL_FORMAT_BGRA:
+ *      Interleaved B, G, R, and A bytes in plane 0. Alpha is ignored.
+ * POSTERIZE_PIXEL_FORMAT_RGB24:
+ *      Interleaved R, G, and B bytes in plane 0, 3 bytes per pixel.
+ *
+ * Chroma samples are not interpolated: each pixel takes the Cb and Cr samples covering it, as Go's
+ * image.YCbCr does.
+ */
+typedef enum posterize_pixel_format
+{
+    POSTERIZE_PIXEL_FORMAT_RGBA = 0,
+    POSTERIZE_PIXEL_FORMAT_I420,
+    POSTERIZE_PIXEL_FORMAT_I422,
+    POSTERIZE_PIXEL_FORMAT_I444,
+    POSTERIZE_PIXEL_FORMAT_NV12,
+    POSTERIZE_PIXEL_FORMAT_BGRA,
+    POSTERIZE_PIXEL_FORMAT_RGB24
+} posterize_pixel_format;
+
+/*
+ * YCbCr to RGB conversions, both using the ITU BT.601 matrix.
+ *
+ * POSTERIZE_YCBCR_RANGE_FULL:
+ *      Y, Cb, and Cr use the full range [0, 255], as in JPEG (JFIF). Conversion is bit-identical to
+ *      Go's color.YCbCrToRGB().
+ * POSTERIZE_YCBCR_RANGE_VIDEO:
+ *      Y uses [16, 235] and Cb and Cr use [16, 240], as is usual for camera and video frames.
+ */
+typedef enum posterize_ycbcr_range
+{
+    POSTERIZE_YCBCR_RANGE_FULL = 0,
+    POSTERIZE_YCBCR_RANGE_VIDEO
+} posterize_ycbcr_range;
+
+/*
+ * Describes an input image in any of the supported pixel layouts. Pixels are numbered in row-major
+ * order, which is the order of the output image.
+ *
+ * Because rows may be farther apart than their width, a descriptor can select a rectangular region
+ * of a larger frame without copying it: point each plane at the region's top left sample and keep
+ * the frame's strides. For subsampled YCbCr formats, the region's left and top edges should be
+ * even so that chroma samples stay aligned with their pixels.
+ *
+ * Fields
+ * ------
+ * format:
+ *      Pixel layout.
+ * width:
+ *      Width in pixels.
+ * height:
+ *      Height in pixels.
+ * planes:
+ *      First row of each plane. Unused planes are ignored.
+ * strides:
+ *      Distance in bytes between the starts of consecutive rows of each plane. Must be at least
+ *      the size of a row.
+ * ycbcrRange:
+ *      Range of YCbCr formats. Ignored for RGBA.
+ */
+typedef struct posterize_image
+{
+    posterize_pixel_format format;
+    size_t width;
+    size_t height;
+    const uint8_t *planes[3];
+    size_t strides[3];
+    posterize_ycbcr_range ycbcrRange;
+} posterize_image;
+
+/*
+ * Same as posterizeWithOptions() but reads the input in any supported layout. Images other than
+ * tightly packed RGBA, including RGBA regions with a stride larger than their width, are converted
+ * to RGBA a band of rows at a time, except that when options->sampleRatio is 1, a converted copy of
+ * the whole image is needed for clustering.
+ *
+ * Parameters
+ * ----------
+ * image:
+ *      Output buffer to which the image, packed at options->bitsPerPixel bits per pixel, will be
+ *      written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * options:
+ *      Options. If NULL, the defaults are used.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeImageWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_image *input, const posterize_options *options, posterize_stats *stats);
+
+/*
+ * Same as posterizeImageWithOptions() but first downscales the input to width x height with a box
+ * filter: each output pixel is the rounded mean of the input pixels in its box, and the boxes tile
+ * the input. Downscaling is fused with reading the input, a tile of pixels at a time, so no
+ * full-size intermediate image is ever created; when options->sampleRatio is 1, clustering needs a
+ * copy of the downscaled image only.
+ *
+ * Parameters
+ * ----------
+ * image:
+ *      Output buffer to which the downscaled image, packed at options->bitsPerPixel bits per pixel,
+ *      will be written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * width:
+ *      Width of the output image. Must not exceed the input's width. If width or height is 0, the
+ *      output image is empty and the palette all black.
+ * height:
+ *      Height of the output image. Must not exceed the input's height.
+ * options:
+ *      Options. If NULL, the defaults are used.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeScaledImageWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_image *input, size_t width, size_t height, const posterize_options *options, posterize_stats *stats);
+
+/*
+ * Supplies rows of a streamed image. Called with rows->width and rows->height set to the image
+ * width and numRows; it must fill in the rest of the descriptor to describe rows firstRow through
+ * firstRow + numRows - 1, in any supported layout. The pixels must remain valid until the next
+ * call or until posterization returns. Rows are requested in order, once per pass.
+ *
+ * Parameters
+ * ----------
+ * userData:
+ *      posterize_stream.userData.
+ * firstRow:
+ *      First row of the band. Always a multiple of 8.
+ * numRows:
+ *      Number of rows in the band.
+ * rows:
+ *      Descriptor to fill in.
+ *
+ * Returns
+ * -------
+ * 0 on success. Any other value stops posterization with POSTERIZE_ERROR_READ_FAILED.
+ */
+typedef int (*posterize_read_rows)(void *userData, size_t firstRow, size_t numRows, posterize_image *rows);
+
+/*
+ * An image delivered a band of rows at a time, for images too large to hold in memory, such as
+ * memory-mapped files or the output of a row-by-row decoder.
+ *
+ * Fields
+ * ------
+ * width:
+ *      Width in pixels.
+ * height:
+ *      Height in pixels.
+ * readRows:
+ *      Callback that supplies each band.
+ * userData:
+ *      Passed to readRows.
+ * bandHeight:
+ *      Rows per band, rounded up to a multiple of 8. If 0, bands of about a million pixels are
+ *      used.
+ */
+typedef struct posterize_stream
+{
+    size_t width;
+    size_t height;
+    posterize_read_rows readRows;
+    void *userData;
+    size_t bandHeight;
+} posterize_stream;
+
+/*
+ * Posterizes a streamed image, keeping only the packed output image, one band of converted pixels,
+ * and a bounded sample of pixels in memory. A first pass over the bands draws an evenly spaced
+ * sample of round(numPixels * options->sampleRatio) pixels, but no more than 4M, from which the
+ * centroids are seeded.
+ *
+ * When options->sampleRatio is 1, each k-means iteration is then one more pass over the bands,
+ * assigning and summing every pixel as the per-pixel engine does, whatever options->engine says.
+ * If the whole image fits in the sample, the result is identical to that of posterizeWithOptions()
+ * with POSTERIZE_ENGINE_PIXELS. When options->sampleRatio is below 1, the selected engine fits the
+ * sample and a final pass assigns every pixel, for two passes in total. options->sampling is
+ * ignored; samples are always evenly spaced.
+ *
+ * Parameters
+ * ----------
+ * image:
+ *      Output buffer to which the image, packed at options->bitsPerPixel bits per pixel, will be
+ *      written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * stream:
+ *      Input image.
+ * options:
+ *      Options. If NULL, the defaults are used.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ * POSTERIZE_ERROR_READ_FAILED if the callback failed or returned an invalid descriptor.
+ */
+extern posterize_status posterizeStreamWithOptions(uint8_t *image, uint8_t *palette24bit, const posterize_stream *stream, const posterize_options *options, posterize_stats *stats);
+
+/*
+ * One image of a batch passed to posterizeBatch().
+ *
+ * Fields
+ * ------
+ * input:
+ *      Input image.
+ * image:
+ *      Output buffer to which the image, packed at options->bitsPerPixel bits per pixel, will be
+ *      written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * stats:
+ *      If not NULL, receives statistics about the image.
+ * status:
+ *      Set to the result for this image: POSTERIZE_OK on success, otherwise an error code, in
+ *      which case its outputs are undefined.
+ */
+typedef struct posterize_batch_item
+{
+    posterize_image input;
+    uint8_t *image;
+    uint8_t *palette24bit;
+    posterize_stats *stats;
+    posterize_status status;
+} posterize_batch_item;
+
+/*
+ * Posterizes many images with the same options, sharing setup and working memory among them. Images
+ * too small to keep every thread busy are spread across the threads, one image per thread at a
+ * time; larger images are processed one after another with all threads. Each image's result is the
+ * same as that of posterizeImageWithOptions() with the same options, except that
+ * options->warmStart is ignored. With a nonzero seed, results do not depend on how images are
+ * scheduled.
+ *
+ * Parameters
+ * ----------
+ * items:
+ *      Images to posterize. Each item's status is set.
+ * numItems:
+ *      Number of items.
+ * options:
+ *      Options. If NULL, the defaults are used.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK if every image was processed, whether or not it succeeded (see each item's status),
+ * otherwise an error code, in which case the items' statuses are undefined.
+ */
+extern posterize_status posterizeBatch(posterize_batch_item *items, size_t numItems, const posterize_options *options);
+
+/*
+ * Quantizes an image to an existing palette: each pixel is mapped to the nearest palette color
+ * (squared Euclidean distance in RGB, ties going to the lowest index) in a single pass, without
+ * clustering. Much faster than posterize(), e.g. for remapping frames to a keyframe's palette.
+ *
+ * Parameters
+ * ----------
+ * image4bit:
+ *      Output buffer to which the 4-bit image will be written. Must be of size numPixels / 2.
+ * palette24bit:
+ *      Palette of 16 RGB triplets. Used as is: the darkest color is not forced to black.
+ * rgbaIn:
+ *      Input RGBA buffer. Alpha is ignored.
+ * numPixels:
+ *      The total number of pixels (i.e., height * width).
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the output is undefined.
+ */
+extern posterize_status posterizeWithPalette(uint8_t *image4bit, const uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels);
+
+/*
+ * Opaque lookup table from colors to the indices of a fixed palette, for remapping many frames to
+ * the same palette. See posterize_lut.
+ */
+typedef struct posterize_palette_lut posterize_palette_lut;
+
+/*
+ * Builds a lookup table for a palette.
+ *
+ * Parameters
+ * ----------
+ * lut:
+ *      Receives the new table, which must be released with posterizeDestroyPaletteLUT().
+ * palette24bit:
+ *      Palette of 16 RGB triplets.
+ * resolution:
+ *      Table resolution. Must not be POSTERIZE_LUT_NONE.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case *lut is set to NULL.
+ */
+extern posterize_status posterizeCreatePaletteLUT(posterize_palette_lut **lut, const uint8_t *palette24bit, posterize_lut resolution);
+
+/*
+ * Same as posterizeWithPalette() but maps pixels through a lookup table. A table may be used by
+ * several threads at once.
+ *
+ * Parameters
+ * ----------
+ * image4bit:
+ *      Output buffer to which the 4-bit image will be written. Must be of size numPixels / 2.
+ * lut:
+ *      Lookup table.
+ * rgbaIn:
+ *      Input RGBA buffer. Alpha is ignored.
+ * numPixels:
+ *      The total number of pixels (i.e., height * width).
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the output is undefined.
+ */
+extern posterize_status posterizeWithPaletteLUT(uint8_t *image4bit, const posterize_palette_lut *lut, const uint8_t *rgbaIn, size_t numPixels);
+
+/*
+ * Destroys a lookup table.
+ *
+ * Parameters
+ * ----------
+ * lut:
+ *      Table to destroy. May be NULL.
+ */
+extern void posterizeDestroyPaletteLUT(posterize_palette_lut *lut);
+
+/*
+ * Opaque posterization context for processing a stream of frames. A context holds the options, the
+ * random number generator state, and scratch memory that is kept between frames and grows only
+ * when a frame needs more than any previous one, so that steady-state processing does not
+ * allocate per-pixel buffers. Small per-call bookkeeping, such as per-thread cluster sums, is
+ * still allocated on each call. A context must not be used by more than one thread at a time, but
+ * each thread may have its own; all contexts share one thread pool.
+ */
+typedef struct posterize_ctx posterize_ctx;
+
+/*
+ * Creates a context.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Receives the new context, which must be released with posterizeDestroyContext().
+ * options:
+ *      Options, copied into the context. If NULL, the defaults are used. The random number
+ *      generator is seeded once, here, and advances from frame to frame, so a nonzero seed makes
+ *      the sequence of results reproducible.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case *ctx is set to NULL.
+ */
+extern posterize_status posterizeCreateContext(posterize_ctx **ctx, const posterize_options *options);
+
+/*
+ * Same as posterizeWithOptions() but with the options and working memory of a context.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context.
+ * image:
+ *      Output buffer to which the image, packed at the context's bitsPerPixel bits per pixel, will
+ *      be written. Must be of size (numPixels * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * rgbaIn:
+ *      Input RGBA buffer. Alpha is ignored.
+ * numPixels:
+ *      The total number of pixels (i.e., height * width).
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const uint8_t *rgbaIn, size_t numPixels, posterize_stats *stats);
+
+/*
+ * Same as posterizeImageWithOptions() but with the options and working memory of a context. The
+ * converted copy needed when sampleRatio is 1 is kept in the context's scratch memory.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context.
+ * image:
+ *      Output buffer to which the image, packed at the context's bitsPerPixel bits per pixel, will
+ *      be written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeImageWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, posterize_stats *stats);
+
+/*
+ * Same as posterizeScaledImageWithOptions() but with the options and working memory of a context.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context.
+ * image:
+ *      Output buffer to which the downscaled image, packed at the context's bitsPerPixel bits per
+ *      pixel, will be written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * width:
+ *      Width of the output image. Must not exceed the input's width. If width or height is 0, the
+ *      output image is empty and the palette all black.
+ * height:
+ *      Height of the output image. Must not exceed the input's height.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ */
+extern posterize_status posterizeScaledImageWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, size_t width, size_t height, posterize_stats *stats);
+
+/*
+ * Same as posterizeStreamWithOptions() but with the options and working memory of a context.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context.
+ * image:
+ *      Output buffer to which the image, packed at the context's bitsPerPixel bits per pixel, will
+ *      be written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * stream:
+ *      Input image.
+ * stats:
+ *      If not NULL, receives statistics about the run.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code, in which case the outputs are undefined.
+ * POSTERIZE_ERROR_READ_FAILED if the callback failed or returned an invalid descriptor.
+ */
+extern posterize_status posterizeStreamWithContext(posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_stream *stream, posterize_stats *stats);
+
+/*
+ * Sets the palette from which the next frame processed with a context starts when warm starting
+ * is enabled, replacing the previous frame's palette.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context.
+ * palette24bit:
+ *      Palette of 2^bitsPerPixel RGB triplets, such as one produced by an earlier call.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK on success, otherwise an error code.
+ */
+extern posterize_status posterizeSetContextPalette(posterize_ctx *ctx, const uint8_t *palette24bit);
+
+/*
+ * Destroys a context and frees its memory.
+ *
+ * Parameters
+ * ----------
+ * ctx:
+ *      Context to destroy. May be NULL.
+ */
+extern void posterizeDestroyContext(posterize_ctx *ctx);
+
+/*
+ * Opaque handle to a posterization running asynchronously on threads owned by the library. The
+ * submitting thread returns at once and collects the result with posterizePollJob(),
+ * posterizeWaitJob(), or the job's event file descriptor. The job's input pixels and outputs must
+ * remain valid until it completes.
+ */
+typedef struct posterize_job posterize_job;
+
+/*
+ * Starts posterizeImageWithOptions() asynchronously. The descriptor and options are copied.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Receives the new job, which must be released with posterizeReleaseJob().
+ * image:
+ *      Output buffer to which the image, packed at options->bitsPerPixel bits per pixel, will be
+ *      written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * options:
+ *      Options. If NULL, the defaults are used.
+ * stats:
+ *      If not NULL, receives statistics about the run when the job completes.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK if the job was submitted, otherwise an error code, in which case *job is set to
+ * NULL. The result of the posterization itself is returned by posterizeWaitJob().
+ */
+extern posterize_status posterizeSubmitImage(posterize_job **job, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, const posterize_options *options, posterize_stats *stats);
+
+/*
+ * Starts posterizeImageWithContext() asynchronously. The descriptor is copied. The context must not
+ * be used again, for submission or otherwise, until the job completes, so frames of one context
+ * are processed one after another.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Receives the new job, which must be released with posterizeReleaseJob().
+ * ctx:
+ *      Context.
+ * image:
+ *      Output buffer to which the image, packed at the context's bitsPerPixel bits per pixel, will
+ *      be written. Must be of size (width * height * bitsPerPixel + 7) / 8.
+ * palette24bit:
+ *      Output buffer to which the final palette of 2^bitsPerPixel RGB triplets will be written.
+ * input:
+ *      Input image.
+ * stats:
+ *      If not NULL, receives statistics about the run when the job completes.
+ *
+ * Returns
+ * -------
+ * POSTERIZE_OK if the job was submitted, otherwise an error code, in which case *job is set to
+ * NULL. The result of the posterization itself is returned by posterizeWaitJob().
+ */
+extern posterize_status posterizeSubmitImageWithContext(posterize_job **job, posterize_ctx *ctx, uint8_t *image, uint8_t *palette24bit, const posterize_image *input, posterize_stats *stats);
+
+/*
+ * Checks whether a job has completed, without blocking.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Job.
+ *
+ * Returns
+ * -------
+ * Nonzero if the job has completed, otherwise 0.
+ */
+extern int posterizePollJob(posterize_job *job);
+
+/*
+ * Blocks until a job has completed.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Job.
+ *
+ * Returns
+ * -------
+ * The result of the posterization: POSTERIZE_OK on success, otherwise an error code, in which case
+ * the outputs are undefined.
+ */
+extern posterize_status posterizeWaitJob(posterize_job *job);
+
+/*
+ * Returns a file descriptor that becomes readable when a job completes, for use with poll(),
+ * epoll, or an event loop. It is a non-blocking Linux eventfd owned by the job and closed by
+ * posterizeReleaseJob(). It is created on the first call, and if the job has already completed by
+ * then, it is readable at once.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Job.
+ *
+ * Returns
+ * -------
+ * The descriptor, or -1 if it could not be created or eventfd is not available on this platform.
+ */
+extern int posterizeJobEventFD(posterize_job *job);
+
+/*
+ * Waits for a job to complete, if it has not already, and frees it.
+ *
+ * Parameters
+ * ----------
+ * job:
+ *      Job to release. May be NULL.
+ */
+extern void posterizeReleaseJob(posterize_job *job);
+
 /*
  * Given a 4-bit linear palettized image and the corresponding palette, produces an RGBA image. This
  * is intended for debugging the posterization algorithm.
@@ -47,4 +977,26 @@ extern void posterize(uint8_t *image4bit, uint8_t *palette24bit, const uint8_t *
  */
 extern void applyColorsToPixelBuffer(uint8_t *rgba, const uint8_t *image4bit, const uint8_t *palette24bit, size_t numPixels);
 
+/*
+ * Same as applyColorsToPixelBuffer() but for an image of any supported depth.
+ *
+ * Parameters
+ * ----------
+ * rgba:
+ *      Output buffer to which the RBGA image is written. Must be sized to hold numPixels * 4 bytes.
+ * image:
+ *      The image, packed at bitsPerPixel bits per pixel.
+ * palette24bit:
+ *      The palette, of 2^bitsPerPixel RGB triplets.
+ * numPixels:
+ *      Number of pixels in the image.
+ * bitsPerPixel:
+ *      Depth of the image: 1, 2, 4, or 8.
+ */
+extern void applyColorsToPixelBufferWithDepth(uint8_t *rgba, const uint8_t *image, const uint8_t *palette24bit, size_t numPixels, unsigned bitsPerPixel);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // POSTERIZE_H
\ No newline at end of file
@@ -0,0 +1,103 @@
+package main
+
+// #include "posterize.h"
+import "C"
+import (
+	"bytes"
+	"fmt"
+	"runtime"
+	"unsafe"
+)
+
+// Posterizes tightly packed RGBA pixels with the default options, except for a fixed seed, a thread
+// limit (0 for all threads), and whether pixels are assigned through the assignment cache. Returns
+// the packed 4-bit image and the 16-color palette.
+func posterizeRGBA(rgba []uint8, seed uint32, numThreads int, assignmentCache bool) ([]uint8, []uint8, error) {
+	numPixels := len(rgba) / 4
+	if numPixels == 0 {
+		return nil, nil, fmt.Errorf("empty image")
+	}
+
+	var options C.posterize_options
+	C.posterizeDefaultOptions(&options)
+	options.seed = C.uint32_t(seed)
+	options.numThreads = C.size_t(numThreads)
+	if assignmentCache {
+		options.assignmentCache = 1
+	}
+
+	// Go memory passed to C may not contain Go pointers, which these byte slices do not
+	image := make([]uint8, (numPixels+1)/2)
+	palette := make([]uint8, 16*3)
+	status := C.posterizeWithOptions((*C.uint8_t)(unsafe.Pointer(&image[0])), (*C.uint8_t)(unsafe.Pointer(&palette[0])), (*C.uint8_t)(unsafe.Pointer(&rgba[0])), C.size_t(numPixels), &options, nil)
+	if status != C.POSTERIZE_OK {
+		return nil, nil, fmt.Errorf("posterization failed with status %d", int(status))
+	}
+	return image, palette, nil
+}
+
+// Pixel formats by name, so that tests need not use cgo
+var pixelFormats = map[string]C.posterize_pixel_format{
+	"RGBA":  C.POSTERIZE_PIXEL_FORMAT_RGBA,
+	"I420":  C.POSTERIZE_PIXEL_FORMAT_I420,
+	"I422":  C.POSTERIZE_PIXEL_FORMAT_I422,
+	"I444":  C.POSTERIZE_PIXEL_FORMAT_I444,
+	"NV12":  C.POSTERIZE_PIXEL_FORMAT_NV12,
+	"BGRA":  C.POSTERIZE_PIXEL_FORMAT_BGRA,
+	"RGB24": C.POSTERIZE_PIXEL_FORMAT_RGB24,
+}
+
+// Posterizes a width x height image of the named pixel format in which width or height is 0, so
+// that there are no planes to point to. Returns the 16-color palette, which starts out filled with
+// 0xaa.
+func posterizeEmptyImage(format string, width, height int) ([]uint8, error) {
+	var input C.posterize_image
+	input.format = pixelFormats[format]
+	input.width = C.size_t(width)
+	input.height = C.size_t(height)
+	image := make([]uint8, 1)
+	palette := bytes.Repeat([]uint8{0xaa}, 16*3)
+	status := C.posterizeImageWithOptions((*C.uint8_t)(unsafe.Pointer(&image[0])), (*C.uint8_t)(unsafe.Pointer(&palette[0])), &input, nil, nil)
+	if status != C.POSTERIZE_OK {
+		return nil, fmt.Errorf("posterization failed with status %d", int(status))
+	}
+	return palette, nil
+}
+
+// Downscales a width x height RGBA image of a single gray level to targetWidth x targetHeight and
+// posterizes it, through a context if useContext is set. Returns the 16-color palette, which
+// starts out filled with 0xaa.
+func posterizeScaledGray(width, height, targetWidth, targetHeight int, useContext bool) ([]uint8, error) {
+	rgba := bytes.Repeat([]uint8{0x80}, width*height*4)
+	var input C.posterize_image
+	input.format = C.POSTERIZE_PIXEL_FORMAT_RGBA
+	input.width = C.size_t(width)
+	input.height = C.size_t(height)
+	input.planes[0] = (*C.uint8_t)(unsafe.Pointer(&rgba[0]))
+	input.strides[0] = C.size_t(width * 4)
+
+	// The descriptor holds a Go pointer, so the memory it points to must be pinned
+	var pinner runtime.Pinner
+	pinner.Pin(&rgba[0])
+	defer pinner.Unpin()
+
+	image := make([]uint8, (targetWidth*targetHeight+1)/2+1)
+	palette := bytes.Repeat([]uint8{0xaa}, 16*3)
+	imagePtr := (*C.uint8_t)(unsafe.Pointer(&image[0]))
+	palettePtr := (*C.uint8_t)(unsafe.Pointer(&palette[0]))
+	var status C.posterize_status
+	if useContext {
+		var ctx *C.posterize_ctx
+		if C.posterizeCreateContext(&ctx, nil) != C.POSTERIZE_OK {
+			return nil, fmt.Errorf("failed to create context")
+		}
+		defer C.posterizeDestroyContext(ctx)
+		status = C.posterizeScaledImageWithContext(ctx, imagePtr, palettePtr, &input, C.size_t(targetWidth), C.size_t(targetHeight), nil)
+	} else {
+		status = C.posterizeScaledImageWithOptions(imagePtr, palettePtr, &input, C.size_t(targetWidth), C.size_t(targetHeight), nil, nil)
+	}
+	if status != C.POSTERIZE_OK {
+		return nil, fmt.Errorf("posterization failed with status %d", int(status))
+	}
+	return palette, nil
+}
@@ -0,0 +1,99 @@
+package main
+
+// #include "posterize.h"
+import "C"
+import (
+	"fmt"
+	"os"
+	"syscall"
+	"unsafe"
+)
+
+// Size of the palette that precedes each frame in an output file: 16 RGB triplets
+const rawPaletteSize = 16 * 3
+
+// Maps the first size bytes of a file. Mappings are shared, so that writes go straight to the file.
+func mapFile(file *os.File, size int, writable bool) ([]byte, error) {
+	prot := syscall.PROT_READ
+	if writable {
+		prot |= syscall.PROT_WRITE
+	}
+	return syscall.Mmap(int(file.Fd()), 0, size, prot, syscall.MAP_SHARED)
+}
+
+// Posterizes a file of back-to-back width x height RGBA frames into a file of records, each a
+// 48-byte palette followed by the frame packed at 4 bits per pixel. Both files are memory mapped, so
+// frames are posterized straight from the input mapping into the output mapping, and a single
+// context's working memory is reused for every frame. A seed of 0 seeds randomly. Returns the
+// number of frames.
+func posterizeRawFrames(inputPath string, outputPath string, width int, height int, seed uint32, warmStart bool) (int, error) {
+	numPixels := width * height
+	frameSize := numPixels * 4
+	recordSize := rawPaletteSize + (numPixels*4+7)/8
+	if numPixels <= 0 {
+		return 0, fmt.Errorf("invalid frame size %dx%d", width, height)
+	}
+
+	inputFile, err := os.Open(inputPath)
+	if err != nil {
+		return 0, err
+	}
+	defer inputFile.Close()
+	info, err := inputFile.Stat()
+	if err != nil {
+		return 0, err
+	}
+	if info.Size()%int64(frameSize) != 0 {
+		return 0, fmt.Errorf("%s is not a whole number of %dx%d RGBA frames", inputPath, width, height)
+	}
+	numFrames := int(info.Size() / int64(frameSize))
+
+	outputFile, err := os.OpenFile(outputPath, os.O_RDWR|os.O_CREATE|os.O_TRUNC, 0644)
+	if err != nil {
+		return 0, err
+	}
+	defer outputFile.Close()
+	if err := outputFile.Truncate(int64(numFrames) * int64(recordSize)); err != nil {
+		return 0, err
+	}
+	if numFrames == 0 {
+		return 0, nil
+	}
+
+	// Frames are visited once, in order
+	input, err := mapFile(inputFile, numFrames*frameSize, false)
+	if err != nil {
+		return 0, err
+	}
+	defer syscall.Munmap(input)
+	output, err := mapFile(outputFile, numFrames*recordSize, true)
+	if err != nil {
+		return 0, err
+	}
+	defer syscall.Munmap(output)
+	syscall.Madvise(input, syscall.MADV_SEQUENTIAL)
+	syscall.Madvise(output, syscall.MADV_SEQUENTIAL)
+
+	var options C.posterize_options
+	C.posterizeDefaultOptions(&options)
+	options.seed = C.uint32_t(seed)
+	if warmStart {
+		options.warmStart = 1
+	}
+	var ctx *C.posterize_ctx
+	if C.posterizeCreateContext(&ctx, &options) != C.POSTERIZE_OK {
+		return 0, fmt.Errorf("unable to create posterization context")
+	}
+	defer C.posterizeDestroyContext(ctx)
+
+	// The mappings are not Go memory, so they can be passed to C without pinning
+	for frame := 0; frame < numFrames; frame++ {
+		rgba := (*C.uint8_t)(unsafe.Pointer(&input[frame*frameSize]))
+		palette := (*C.uint8_t)(unsafe.Pointer(&output[frame*recordSize]))
+		image := (*C.uint8_t)(unsafe.Pointer(&output[frame*recordSize+rawPaletteSize]))
+		if C.posterizeWithContext(ctx, image, palette, rgba, C.size_t(numPixels), nil) != C.POSTERIZE_OK {
+			return frame, fmt.Errorf("posterization of frame %d failed", frame)
+		}
+	}
+	return numFrames, nil
+}
@@ -0,0 +1,96 @@
+/*
+ * sampling.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Pixel subsampling, used to fit centroids on a fraction of an image.
+ */
+
+#include "sampling.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint8_t *samplePixels(size_t *numSamples, const InputImage &input, float ratio, posterize_sampling method, std::mt19937 &rng, const Workers &workers, ScratchArena &scratch)
+{
+    size_t numPixels = input.numPixels();
+    const uint8_t *rgba = input.rgba();
+
+    // Copies pixel j to a sample, converting it if the image is not RGBA
+    auto readPixel = [&](uint8_t *sample, size_t j)
+    {
+        if (rgba)
+        {
+            memcpy(sample, &rgba[j * 4], 4);
+        }
+        else
+        {
+            input.convert(sample, j, 1);
+        }
+    };
+
+    *numSamples = numPixels == 0 ? 0 : std::clamp(size_t(std::llround(double(numPixels) * ratio)), size_t(1), numPixels);
+    uint8_t *samples = scratch.allocate<uint8_t>(*numSamples * 4);
+    if (numPixels == 0)
+    {
+        return samples;
+    }
+    double step = double(numPixels) / double(*numSamples);
+
+    if (method == POSTERIZE_SAMPLING_RANDOM)
+    {
+        std::uniform_int_distribution<size_t> random(0, numPixels - 1);
+        for (size_t i = 0; i < *numSamples; i++)
+        {
+            readPixel(&samples[i * 4], random(rng));
+        }
+        return samples;
+    }
+
+    PixelChunks chunks(*numSamples, workers.numThreads);
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        for (size_t i = chunks.begin(chunk); i < chunks.begin(chunk) + chunks.size(chunk); i++)
+        {
+            size_t first = size_t(double(i) * step);
+            if (method == POSTERIZE_SAMPLING_STRIDE)
+            {
+                readPixel(&samples[i * 4], first);
+                continue;
+            }
+
+            // Box: average the pixels between this sample and the next, converting a few at a time
+            // if needed
+            size_t last = std::min(std::max(size_t(double(i + 1) * step), first + 1), numPixels);
+            uint64_t r = 0;
+            uint64_t g = 0;
+            uint64_t b = 0;
+            constexpr size_t maxConverted = 64;
+            uint8_t converted[maxConverted * 4];
+            for (size_t runStart = first; runStart < last; runStart += maxConverted)
+            {
+                size_t runPixels = std::min(maxConverted, last - runStart);
+                const uint8_t *pixels = converted;
+                if (rgba)
+                {
+                    pixels = &rgba[runStart * 4];
+                }
+                else
+                {
+                    input.convert(converted, runStart, runPixels);
+                }
+                for (size_t j = 0; j < runPixels; j++)
+                {
+                    r += pixels[j * 4 + 0];
+                    g += pixels[j * 4 + 1];
+                    b += pixels[j * 4 + 2];
+                }
+            }
+            uint64_t n = last - first;
+            samples[i * 4 + 0] = uint8_t((r + n / 2) / n);
+            samples[i * 4 + 1] = uint8_t((g + n / 2) / n);
+            samples[i * 4 + 2] = uint8_t((b + n / 2) / n);
+            samples[i * 4 + 3] = 0;
+        }
+    });
+    return samples;
+}
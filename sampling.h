@@ -0,0 +1,25 @@
+/*
+ * sampling.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Pixel subsampling, used to fit centroids on a fraction of an image.
+ */
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "posterize.h"
+#include "input_image.h"
+#include "kmeans.h"
+#include "scratch_arena.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+// Returns an RGBA buffer, allocated from scratch, of round(numPixels * ratio) pixels (at least one,
+// unless the image is empty) drawn from the image. Images that are not RGBA are converted only
+// where sampled. The number of samples is written to numSamples. The rng is only used by
+// POSTERIZE_SAMPLING_RANDOM.
+extern uint8_t *samplePixels(size_t *numSamples, const InputImage &input, float ratio, posterize_sampling method, std::mt19937 &rng, const Workers &workers, ScratchArena &scratch);
+
+#endif // SAMPLING_H
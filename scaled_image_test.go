@@ -0,0 +1,24 @@
+package main
+
+import "testing"
+
+// Downscaling to a width or height of 0 succeeds with an all-black palette, with options or with a
+// context
+func TestScaleToNothing(t *testing.T) {
+	targets := [][2]int{{0, 5}, {5, 0}, {0, 0}}
+	for _, useContext := range []bool{false, true} {
+		for _, target := range targets {
+			palette, err := posterizeScaledGray(20, 20, target[0], target[1], useContext)
+			if err != nil {
+				t.Errorf("%dx%d, context %v: %v", target[0], target[1], useContext, err)
+				continue
+			}
+			for _, value := range palette {
+				if value != 0 {
+					t.Errorf("%dx%d, context %v: palette is not black", target[0], target[1], useContext)
+					break
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ * scratch_arena.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Bump allocator for the working buffers of a posterize call.
+ */
+
+#include "scratch_arena.h"
+
+uint8_t *ScratchArena::align(uint8_t *ptr)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    return ptr + ((kAlignment - address % kAlignment) % kAlignment);
+}
+
+void *ScratchArena::allocateBytes(size_t numBytes)
+{
+    size_t size = (numBytes + kAlignment - 1) & ~(kAlignment - 1);
+    if (m_used + size <= m_capacity)
+    {
+        void *ptr = align(m_block.get()) + m_used;
+        m_used += size;
+        return ptr;
+    }
+
+    // Does not fit: allocate separately until the next reset() consolidates
+    m_overflowBlocks.emplace_back(new uint8_t[size + kAlignment]);
+    m_overflowBytes += size;
+    return align(m_overflowBlocks.back().get());
+}
+
+void ScratchArena::reset()
+{
+    if (!m_overflowBlocks.empty())
+    {
+        size_t capacity = m_used + m_overflowBytes;
+        m_overflowBlocks.clear();
+        m_overflowBytes = 0;
+        m_block.reset();
+        m_capacity = 0;
+        m_block.reset(new uint8_t[capacity + kAlignment]);
+        m_capacity = capacity;
+    }
+    m_used = 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * scratch_arena.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Bump allocator for the working buffers of a posterize call. Memory is kept from one call to the
+ * next, so that a stream of frames only allocates when a frame needs more scratch space than any
+ * frame before it.
+ */
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+class ScratchArena
+{
+public:
+    // Returns uninitialized, cache line-aligned storage for count objects of trivial type T. The
+    // storage remains valid until reset(). Must not be called concurrently.
+    template <typename T>
+    T *allocate(size_t count)
+    {
+        static_assert(std::is_trivial<T>::value, "ScratchArena only holds trivial types");
+        static_assert(alignof(T) <= kAlignment, "ScratchArena cannot satisfy alignment");
+        return reinterpret_cast<T *>(allocateBytes(count * sizeof(T)));
+    }
+
+    // Copies count objects into a new allocation of newCount objects, for arrays that grow
+    template <typename T>
+    T *reallocate(const T *data, size_t count, size_t newCount)
+    {
+        T *newData = allocate<T>(newCount);
+        std::copy(data, data + count, newData);
+        return newData;
+    }
+
+    // Releases all allocations. If they did not fit in the main block, it is replaced with a block
+    // large enough to have held them all.
+    void reset();
+
+    // Size of the main block in bytes
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    static constexpr size_t kAlignment = 64;
+
+    void *allocateBytes(size_t numBytes);
+    static uint8_t *align(uint8_t *ptr);
+
+    std::unique_ptr<uint8_t[]> m_block;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> m_overflowBlocks;
+    size_t m_overflowBytes = 0;
+};
+
+#endif // SCRATCH_ARENA_H
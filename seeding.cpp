@@ -0,0 +1,185 @@
+/*
+ * seeding.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Strategies for choosing the initial centroids of k-means.
+ */
+
+#include "seeding.h"
+#include <algorithm>
+#include <vector>
+
+// Centroids of a uniformly random labeling of the pixels. Labels are drawn one pixel at a time in
+// a fixed order so that a given seed always produces the same centroids.
+static void seedFromRandomLabels(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<std::mt19937::result_type> random(0, unsigned(numCentroids - 1));   // [0, numColors-1]
+    Color sums[kMaxCentroids];
+    size_t counts[kMaxCentroids] = {};
+    for (size_t i = 0; i < numPixels * 4; i += 4)
+    {
+        size_t k = random(rng);
+        sums[k].r += rgba[i + 0];
+        sums[k].g += rgba[i + 1];
+        sums[k].b += rgba[i + 2];
+        counts[k]++;
+    }
+    computeCentroids(centroids, numCentroids, sums, counts);
+}
+
+// k-means++ on an evenly spaced sample of pixels: the first centroid is a random sample and each
+// subsequent one is drawn with probability proportional to its squared distance from the nearest
+// centroid chosen so far.
+static void seedKMeansPlusPlus(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, std::mt19937 &rng)
+{
+    constexpr size_t maxSamples = 4096;
+    size_t numSamples = std::min(numPixels, maxSamples);
+    if (numSamples == 0)
+    {
+        std::fill(centroids, centroids + numCentroids, Centroid{ 0, 0, 0 });
+        return;
+    }
+    std::vector<Centroid> samples(numSamples);
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        const uint8_t *pixel = &rgba[(i * numPixels / numSamples) * 4];
+        samples[i] = { pixel[0], pixel[1], pixel[2] };
+    }
+
+    std::vector<uint32_t> nearestDistance(numSamples, UINT32_MAX);
+    std::uniform_real_distribution<double> random(0.0, 1.0);
+    size_t chosen = std::uniform_int_distribution<size_t>(0, numSamples - 1)(rng);
+    for (size_t k = 0; k < numCentroids; k++)
+    {
+        centroids[k] = samples[chosen];
+
+        // Update distances to nearest centroid
+        double total = 0;
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            int32_t dr = int32_t(samples[i].r) - centroids[k].r;
+            int32_t dg = int32_t(samples[i].g) - centroids[k].g;
+            int32_t db = int32_t(samples[i].b) - centroids[k].b;
+            nearestDistance[i] = std::min(nearestDistance[i], uint32_t(dr * dr + dg * dg + db * db));
+            total += nearestDistance[i];
+        }
+
+        // Draw the next one. If every sample coincides with a centroid, just repeat the last one.
+        if (k + 1 == numCentroids || total == 0)
+        {
+            continue;
+        }
+        double target = random(rng) * total;
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            if (nearestDistance[i] != 0)
+            {
+                chosen = i;
+                target -= nearestDistance[i];
+                if (target < 0)
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Deterministic seeding: pixels are ordered by luminance and split into one group of equal size per
+// centroid, whose mean colors become the centroids. Pixels are bucketed by 8-bit luminance, and a
+// bucket that straddles two groups is split between them in proportion.
+static void seedFromLuminanceQuantiles(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, const Workers &workers)
+{
+    struct Bucket
+    {
+        Color sum;
+        size_t count = 0;
+    };
+
+    // Build luminance histogram (BT.601 weights) in parallel
+    PixelChunks chunks(numPixels, workers.numThreads);
+    std::vector<std::vector<Bucket>> chunkBuckets(chunks.count());
+    workers.parallelFor(chunks.count(), [&](size_t chunk)
+    {
+        std::vector<Bucket> &buckets = chunkBuckets[chunk];
+        buckets.resize(256);
+        const uint8_t *pixels = &rgba[chunks.begin(chunk) * 4];
+        for (size_t i = 0; i < chunks.size(chunk) * 4; i += 4)
+        {
+            uint8_t r = pixels[i + 0];
+            uint8_t g = pixels[i + 1];
+            uint8_t b = pixels[i + 2];
+            Bucket &bucket = buckets[(77 * r + 150 * g + 29 * b) >> 8];
+            bucket.sum.r += r;
+            bucket.sum.g += g;
+            bucket.sum.b += b;
+            bucket.count++;
+        }
+    });
+
+    // Walk up the luminance range, filling each group with numPixels / numCentroids pixels
+    double groupSize = double(numPixels) / double(numCentroids);
+    double sumR[kMaxCentroids] = {};
+    double sumG[kMaxCentroids] = {};
+    double sumB[kMaxCentroids] = {};
+    double count[kMaxCentroids] = {};
+    size_t k = 0;
+    for (size_t luma = 0; luma < 256; luma++)
+    {
+        Bucket bucket;
+        for (const std::vector<Bucket> &buckets : chunkBuckets)
+        {
+            bucket.sum.r += buckets[luma].sum.r;
+            bucket.sum.g += buckets[luma].sum.g;
+            bucket.sum.b += buckets[luma].sum.b;
+            bucket.count += buckets[luma].count;
+        }
+
+        double remaining = double(bucket.count);
+        while (remaining > 0)
+        {
+            double capacity = k == numCentroids - 1 ? remaining : groupSize - count[k];
+            if (capacity <= 0)
+            {
+                k++;
+                continue;
+            }
+            double share = std::min(remaining, capacity);
+            double fraction = share / double(bucket.count);
+            sumR[k] += double(bucket.sum.r) * fraction;
+            sumG[k] += double(bucket.sum.g) * fraction;
+            sumB[k] += double(bucket.sum.b) * fraction;
+            count[k] += share;
+            remaining -= share;
+        }
+    }
+
+    for (size_t i = 0; i < numCentroids; i++)
+    {
+        if (count[i] > 0)
+        {
+            centroids[i] = { uint8_t(sumR[i] / count[i] + 0.5), uint8_t(sumG[i] / count[i] + 0.5), uint8_t(sumB[i] / count[i] + 0.5) };
+        }
+        else
+        {
+            centroids[i] = { 0, 0, 0 };
+        }
+    }
+}
+
+void seedCentroids(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, posterize_seeding seeding, std::mt19937 &rng, const Workers &workers)
+{
+    switch (seeding)
+    {
+    default:
+    case POSTERIZE_SEEDING_RANDOM_LABELS:
+        seedFromRandomLabels(centroids, numCentroids, rgba, numPixels, rng);
+        break;
+    case POSTERIZE_SEEDING_KMEANS_PLUS_PLUS:
+        seedKMeansPlusPlus(centroids, numCentroids, rgba, numPixels, rng);
+        break;
+    case POSTERIZE_SEEDING_LUMINANCE_QUANTILES:
+        seedFromLuminanceQuantiles(centroids, numCentroids, rgba, numPixels, workers);
+        break;
+    }
+}
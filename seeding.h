@@ -0,0 +1,21 @@
+/*
+ * seeding.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Strategies for choosing the initial centroids of k-means.
+ */
+
+#ifndef SEEDING_H
+#define SEEDING_H
+
+#include "posterize.h"
+#include "kmeans.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+// Chooses numCentroids initial centroids for the pixels of an RGBA image. The alpha channel is
+// ignored.
+extern void seedCentroids(Centroid centroids[], size_t numCentroids, const uint8_t *rgba, size_t numPixels, posterize_seeding seeding, std::mt19937 &rng, const Workers &workers);
+
+#endif // SEEDING_H
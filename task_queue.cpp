@@ -0,0 +1,68 @@
+/*
+ * task_queue.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Library-owned threads that run independent tasks in order of submission.
+ */
+
+#include "task_queue.h"
+#include <algorithm>
+
+TaskQueue::TaskQueue(size_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        m_workers.emplace_back(&TaskQueue::workerLoop, this);
+    }
+}
+
+TaskQueue::~TaskQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeWorkers.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void TaskQueue::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wakeWorkers.notify_one();
+}
+
+TaskQueue &TaskQueue::shared()
+{
+    static TaskQueue *queue = new TaskQueue();
+    return *queue;
+}
+
+void TaskQueue::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeWorkers.wait(lock, [&]() { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty())
+        {
+            return;     // stopping and drained
+        }
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * task_queue.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Library-owned threads that run independent tasks, such as whole posterize calls submitted
+ * asynchronously, in order of submission. Unlike ThreadPool, which splits one loop among threads
+ * while its caller waits, a task queue never blocks the submitting thread.
+ */
+
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskQueue
+{
+public:
+    // Creates a queue served by numThreads threads. If numThreads is 0, the number of hardware
+    // threads is used.
+    explicit TaskQueue(size_t numThreads = 0);
+
+    // Runs any tasks still queued before returning
+    ~TaskQueue();
+
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
+
+    // Queues a task to run on one of the queue's threads. Tasks must not throw.
+    void submit(std::function<void()> task);
+
+    // Process-wide queue sized to the number of hardware threads. Created on first use and never
+    // destroyed.
+    static TaskQueue &shared();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;     // protects the state below
+    std::condition_variable m_wakeWorkers;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stop = false;
+};
+
+#endif // TASK_QUEUE_H
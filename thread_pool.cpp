@@ -0,0 +1,126 @@
+/*
+ * thread_pool.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Reusable pool of worker threads for data-parallel loops.
+ */
+
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 1; i < numThreads; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeWorkers.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t numTasks, const std::function<void(size_t task)> &fn, size_t maxThreads)
+{
+    if (maxThreads == 0 || maxThreads > numThreads())
+    {
+        maxThreads = numThreads();
+    }
+
+    // Run serially when there is nothing to gain or when another loop already owns the workers. A
+    // nested call from the owning thread must not try to lock the loop mutex, which it already holds.
+    bool isNested = m_loopOwner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    if (maxThreads <= 1 || numTasks <= 1 || isNested || !m_loopMutex.try_lock())
+    {
+        for (size_t task = 0; task < numTasks; task++)
+        {
+            fn(task);
+        }
+        return;
+    }
+    std::lock_guard<std::mutex> loopLock(m_loopMutex, std::adopt_lock);
+    m_loopOwner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    // Publish the loop and wake up the workers
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_numTasks = numTasks;
+        m_nextTask = 0;
+        m_maxHelpers = std::min(maxThreads, numTasks) - 1;
+        m_numHelpers = 0;
+        m_generation++;
+    }
+    m_wakeWorkers.notify_all();
+
+    runTasks();
+
+    // Wait for helpers to finish and close the loop so that late-waking workers skip it
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workersDone.wait(lock, [this]() { return m_numActive == 0; });
+    m_maxHelpers = 0;
+    m_fn = nullptr;
+    m_loopOwner.store(std::thread::id(), std::memory_order_relaxed);
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool *pool = new ThreadPool();
+    return *pool;
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t lastGeneration = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeWorkers.wait(lock, [&]() { return m_stop || m_generation != lastGeneration; });
+        if (m_stop)
+        {
+            return;
+        }
+        lastGeneration = m_generation;
+        if (m_numHelpers >= m_maxHelpers)
+        {
+            continue;
+        }
+        m_numHelpers++;
+        m_numActive++;
+
+        lock.unlock();
+        runTasks();
+        lock.lock();
+
+        if (--m_numActive == 0)
+        {
+            m_workersDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::runTasks()
+{
+    while (true)
+    {
+        size_t task = m_nextTask.fetch_add(1);
+        if (task >= m_numTasks)
+        {
+            return;
+        }
+        (*m_fn)(task);
+    }
+}
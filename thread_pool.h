@@ -0,0 +1,68 @@
+/*
+ * thread_pool.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Reusable pool of worker threads for data-parallel loops.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Creates a pool that runs loops on up to numThreads threads, including the calling thread. If
+    // numThreads is 0, the number of hardware threads is used.
+    explicit ThreadPool(size_t numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Maximum number of threads a loop can run on, including the calling thread
+    size_t numThreads() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    // Calls fn(task) for each task in [0, numTasks) and returns when all have completed. The calling
+    // thread participates and at most maxThreads threads are used (0 for no limit). If the pool is
+    // already busy with another loop (e.g., a concurrent or nested call), the tasks are simply run
+    // on the calling thread.
+    void parallelFor(size_t numTasks, const std::function<void(size_t task)> &fn, size_t maxThreads = 0);
+
+    // Process-wide pool sized to the number of hardware threads. Created on first use and never
+    // destroyed.
+    static ThreadPool &shared();
+
+private:
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_loopMutex;     // held by the thread that owns the current loop
+    std::atomic<std::thread::id> m_loopOwner;   // that thread, so that it can detect nested calls
+    std::mutex m_mutex;         // protects the state below
+    std::condition_variable m_wakeWorkers;
+    std::condition_variable m_workersDone;
+    uint64_t m_generation = 0;
+    size_t m_maxHelpers = 0;    // how many workers may join the current loop
+    size_t m_numHelpers = 0;    // how many have joined so far
+    size_t m_numActive = 0;     // how many are still running tasks
+    bool m_stop = false;
+
+    // Current loop
+    const std::function<void(size_t)> *m_fn = nullptr;
+    size_t m_numTasks = 0;
+    std::atomic<size_t> m_nextTask{ 0 };
+};
+
+#endif // THREAD_POOL_H
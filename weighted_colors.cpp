@@ -0,0 +1,216 @@
+/*
+ * weighted_colors.cpp
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Compact representations of an image as a set of weighted colors.
+ */
+
+#include "weighted_colors.h"
+#include <algorithm>
+
+// Histogram bin. Rather than full RGB sums, each bin accumulates the offsets of its pixels from the
+// bin's base color. These are at most 7 per channel and so cannot overflow 32 bits for any
+// realistic number of pixels per task.
+struct HistogramBin
+{
+    uint32_t count;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+};
+
+WeightedColors buildColorHistogram(const uint8_t *rgba, size_t numPixels, unsigned rBits, unsigned gBits, unsigned bBits, const Workers &workers, ScratchArena &scratch)
+{
+    const unsigned rShift = 8 - rBits;
+    const unsigned gShift = 8 - gBits;
+    const unsigned bShift = 8 - bBits;
+    const uint8_t rMask = (1 << rShift) - 1;
+    const uint8_t gMask = (1 << gShift) - 1;
+    const uint8_t bMask = (1 << bShift) - 1;
+    const size_t numBins = size_t(1) << (rBits + gBits + bBits);
+
+    // Each task fills its own histogram for a contiguous slice of the image. Tasks are limited to
+    // 2^28 pixels to keep the per-bin offset sums from overflowing.
+    constexpr size_t minPixelsPerTask = 65536;
+    constexpr size_t maxPixelsPerTask = size_t(1) << 28;
+    size_t numTasks = std::min(workers.numThreads, (numPixels + minPixelsPerTask - 1) / minPixelsPerTask);
+    numTasks = std::max(numTasks, (numPixels + maxPixelsPerTask - 1) / maxPixelsPerTask);
+    numTasks = std::max(numTasks, size_t(1));
+    size_t pixelsPerTask = (numPixels + numTasks - 1) / numTasks;
+    HistogramBin *taskBins = scratch.allocate<HistogramBin>(numTasks * numBins);
+    workers.parallelFor(numTasks, [&](size_t task)
+    {
+        HistogramBin *bins = &taskBins[task * numBins];
+        std::fill(bins, bins + numBins, HistogramBin());
+        size_t first = task * pixelsPerTask;
+        size_t last = std::min(numPixels, first + pixelsPerTask);
+        for (size_t i = first; i < last; i++)
+        {
+            uint8_t r = rgba[i * 4 + 0];
+            uint8_t g = rgba[i * 4 + 1];
+            uint8_t b = rgba[i * 4 + 2];
+            size_t bin = (size_t(r >> rShift) << (gBits + bBits)) | (size_t(g >> gShift) << bBits) | (b >> bShift);
+            bins[bin].count++;
+            bins[bin].r += r & rMask;
+            bins[bin].g += g & gMask;
+            bins[bin].b += b & bMask;
+        }
+    });
+
+    // Merge the task histograms and emit one color per occupied bin
+    WeightedColors colors;
+    colors.rgba = scratch.allocate<uint8_t>(numBins * 4);
+    colors.counts = scratch.allocate<uint32_t>(numBins);
+    for (size_t bin = 0; bin < numBins; bin++)
+    {
+        uint64_t count = 0;
+        uint64_t r = 0;
+        uint64_t g = 0;
+        uint64_t b = 0;
+        for (size_t task = 0; task < numTasks; task++)
+        {
+            const HistogramBin &taskBin = taskBins[task * numBins + bin];
+            count += taskBin.count;
+            r += taskBin.r;
+            g += taskBin.g;
+            b += taskBin.b;
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+
+        // Mean color, rounded, is base of the bin plus the mean offset
+        size_t rBase = (bin >> (gBits + bBits)) << rShift;
+        size_t gBase = ((bin >> bBits) & ((1 << gBits) - 1)) << gShift;
+        size_t bBase = (bin & ((1 << bBits) - 1)) << bShift;
+        uint8_t *color = &colors.rgba[colors.numColors * 4];
+        color[0] = uint8_t(rBase + (r + count / 2) / count);
+        color[1] = uint8_t(gBase + (g + count / 2) / count);
+        color[2] = uint8_t(bBase + (b + count / 2) / count);
+        color[3] = 0;
+        colors.counts[colors.numColors++] = uint32_t(count);
+    }
+    return colors;
+}
+
+// Open-addressing hash table mapping 24-bit colors to indices. Keys are stored as color + 1 so that
+// 0 marks an empty slot. The table doubles whenever it becomes half full.
+class ColorIndexTable
+{
+public:
+    ColorIndexTable(ScratchArena &scratch)
+        : m_scratch(scratch)
+    {
+        resize(1 << 16);
+    }
+
+    // Returns index of color, inserting it with the given index if not present
+    uint32_t findOrInsert(uint32_t rgb, uint32_t newIndex)
+    {
+        uint32_t key = rgb + 1;
+        size_t slot = hash(rgb);
+        while (m_keys[slot] != 0)
+        {
+            if (m_keys[slot] == key)
+            {
+                return m_indices[slot];
+            }
+            slot = (slot + 1) & m_mask;
+        }
+        m_keys[slot] = key;
+        m_indices[slot] = newIndex;
+        if (++m_size * 2 > m_capacity)
+        {
+            resize(m_capacity * 2);
+        }
+        return newIndex;
+    }
+
+private:
+    size_t hash(uint32_t rgb) const
+    {
+        return (uint32_t(rgb * 0x9e3779b1u) >> m_shift) & m_mask;
+    }
+
+    void resize(size_t capacity)
+    {
+        const uint32_t *keys = m_keys;
+        const uint32_t *indices = m_indices;
+        size_t oldCapacity = m_capacity;
+        m_keys = m_scratch.allocate<uint32_t>(capacity);
+        m_indices = m_scratch.allocate<uint32_t>(capacity);
+        std::fill(m_keys, m_keys + capacity, 0);
+        m_capacity = capacity;
+        m_mask = capacity - 1;
+        m_shift = 32;
+        for (size_t c = capacity; c > 1; c >>= 1)
+        {
+            m_shift--;
+        }
+        for (size_t slot = 0; slot < oldCapacity; slot++)
+        {
+            if (keys[slot] != 0)
+            {
+                size_t newSlot = hash(keys[slot] - 1);
+                while (m_keys[newSlot] != 0)
+                {
+                    newSlot = (newSlot + 1) & m_mask;
+                }
+                m_keys[newSlot] = keys[slot];
+                m_indices[newSlot] = indices[slot];
+            }
+        }
+    }
+
+    ScratchArena &m_scratch;
+    uint32_t *m_keys = nullptr;
+    uint32_t *m_indices = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+    size_t m_mask = 0;
+    unsigned m_shift = 32;
+};
+
+WeightedColors buildUniqueColors(const uint8_t *rgba, size_t numPixels, ScratchArena &scratch)
+{
+    WeightedColors colors;
+    size_t capacity = 0;
+    ColorIndexTable table(scratch);
+    uint32_t previousRGB = UINT32_MAX;
+    uint32_t previousIndex = 0;
+    for (size_t i = 0; i < numPixels * 4; i += 4)
+    {
+        uint8_t r = rgba[i + 0];
+        uint8_t g = rgba[i + 1];
+        uint8_t b = rgba[i + 2];
+
+        // Runs of identical pixels are common, so check the previous pixel before the table
+        uint32_t rgb = (uint32_t(r) << 16) | (uint32_t(g) << 8) | b;
+        uint32_t newIndex = uint32_t(colors.numColors);
+        uint32_t index = rgb == previousRGB ? previousIndex : table.findOrInsert(rgb, newIndex);
+        previousRGB = rgb;
+        previousIndex = index;
+        if (index == newIndex)
+        {
+            if (colors.numColors == capacity)
+            {
+                size_t newCapacity = std::max(capacity * 2, size_t(4096));
+                colors.rgba = scratch.reallocate(colors.rgba, capacity * 4, newCapacity * 4);
+                colors.counts = scratch.reallocate(colors.counts, capacity, newCapacity);
+                capacity = newCapacity;
+            }
+            uint8_t *color = &colors.rgba[newIndex * 4];
+            color[0] = r;
+            color[1] = g;
+            color[2] = b;
+            color[3] = 0;
+            colors.counts[colors.numColors++] = 1;
+        }
+        else
+        {
+            colors.counts[index]++;
+        }
+    }
+    return colors;
+}
@@ -0,0 +1,40 @@
+/*
+ * weighted_colors.h
+ * Bart Trzynadlowski, 10/16/2026
+ *
+ * Compact representations of an image as a set of colors, each weighted by the number of pixels it
+ * stands for. k-means over such a set costs time proportional to the number of colors rather than
+ * the number of pixels.
+ */
+
+#ifndef WEIGHTED_COLORS_H
+#define WEIGHTED_COLORS_H
+
+#include "kmeans.h"
+#include "scratch_arena.h"
+#include <cstddef>
+#include <cstdint>
+
+// Colors are stored as RGBA, like pixels, so that the same k-means code can process both. Alpha is
+// unused. Storage is allocated from a ScratchArena.
+struct WeightedColors
+{
+    uint8_t *rgba = nullptr;
+    uint32_t *counts = nullptr;
+    size_t numColors = 0;
+
+    size_t size() const
+    {
+        return numColors;
+    }
+};
+
+// Builds a color histogram with the given number of bits per channel (at most 8 each). Each
+// occupied bin becomes one color: the mean of the pixels that fell into it.
+extern WeightedColors buildColorHistogram(const uint8_t *rgba, size_t numPixels, unsigned rBits, unsigned gBits, unsigned bBits, const Workers &workers, ScratchArena &scratch);
+
+// Compacts an image into its exact set of unique 24-bit colors, in order of first appearance, using
+// an open-addressing hash table.
+extern WeightedColors buildUniqueColors(const uint8_t *rgba, size_t numPixels, ScratchArena &scratch);
+
+#endif // WEIGHTED_COLORS_H